@@ -0,0 +1,421 @@
+/** *********************************************************************** **/
+/**                                                                         **/
+/**  Benchmark.c                                                            **/
+/**  -----------                                                            **/
+/**                                                                         **/
+/** Content: A command line benchmark for the MedianSort templates          **/
+/**                                                                         **/
+/** Author:  Carlos Luna Mota                                               **/
+/**                                                                         **/
+/** Source:  <https://github.com/CarlosLunaMota/MedianSort>                 **/
+/**                                                                         **/
+/** License: The Unlicense                                                  **/
+/**                                                                         **/
+/** This is free and unencumbered software released into the public domain. **/
+/**                                                                         **/
+/** For more information, please refer to <http://unlicense.org/>           **/
+/**                                                                         **/
+/** *********************************************************************** **/
+
+
+/** LIBRARIES ************************************************************* **/
+
+#define MEDIAN_SORT_TEMPLATES_ONLY
+
+#include "MedianSort.c" /* The sorting templates (without their benchmark).  */
+
+
+/** USAGE ***************************************************************** **/
+
+static const char *usage =
+"Usage: bench [options]\n"
+"\n"
+"  -a LIST  algorithms   (default: all of them)\n"
+"  -k LIST  key types    (default: i32)\n"
+"  -d LIST  inputs       (default: random)\n"
+"  -n LIST  sizes        (default: 1000,10000,100000,1000000)\n"
+"  -r N     repetitions  (default: 11)\n"
+"  -s N     random seed  (default: 1)\n"
+"  -t N     threads of parallel_median_sort (default: online cores)\n"
+"  -p X     fraction of random elements of nearly_sorted (default: 0.01)\n"
+"  -f FMT   output: table (like log.txt, for format.plt), csv or json\n"
+"           (default: table)\n"
+"\n"
+"Every instance is sorted by all the algorithms, checked against qsort and\n"
+"timed with CLOCK_MONOTONIC. The table has one column per algorithm with\n"
+"its median time as a percentage of the median time of qsort (or in ns per\n"
+"element if qsort is not selected), and one block per key type and input.\n"
+"The csv and json outputs have one record per algorithm, key type, input\n"
+"and size with the min, p10, median, p90 and max times (in ns) and the\n"
+"median ns per element. Progress is written to stderr.\n";
+
+static const char *algorithm_names[] = {
+    "qsort", "median_sort", "block_median_sort", "simd_median_sort",
+    "median_sort_generic", "parallel_median_sort", "quick_sort",
+    "block_quick_sort", "heap_sort", "shell_sort", "adaptive_median_sort"
+};
+
+static const char *key_names[] = { "i32", "i64", "f32", "f64" };
+
+static const char *input_names[] = {
+    "random", "sorted", "reverse", "organ_pipe", "sawtooth", "few_unique",
+    "zipf", "partitioned", "nearly_sorted"
+};
+
+#define ALGORITHMS 11
+#define KEYS        4
+#define INPUTS      9
+#define MAX_SIZES  32
+
+
+/** INPUT DISTRIBUTIONS *************************************************** **/
+
+static double perturbed = 0.01;     /* Random elements of nearly_sorted      */
+
+static int64_t random_below(const int64_t n) {
+
+    /* Uniformly random integer in [0, n) (n < 2^62) */
+    const uint64_t range = (uint64_t) n;
+    const uint64_t limit = UINT64_MAX - (UINT64_MAX % range);
+    uint64_t r;
+    do {r = ((uint64_t) rand() << 62) ^ ((uint64_t) rand() << 31) ^
+            (uint64_t) rand();
+    } while (r >= limit);
+    return (int64_t) (r % range);
+}
+
+static int64_t input_value(const size_t input, const size_t i,
+                           const size_t n) {
+
+    const int64_t k = (int64_t) i, m = (int64_t) n;
+    double u;
+
+    switch (input) {
+        case 0:  return random_below(m);                        /* random      */
+        case 1:  return k;                                      /* sorted      */
+        case 2:  return m-k;                                    /* reverse     */
+        case 3:  return (k < m/2) ? k : m-k;                    /* organ_pipe  */
+        case 4:  return k % ((m+15)/16);                        /* sawtooth    */
+        case 5:  return random_below(16);                       /* few_unique  */
+        case 6:  u = (double) rand() / ((double) RAND_MAX + 1); /* zipf (1.1)  */
+                 return (int64_t) pow(1.0 - u*(1.0 - pow((double) m, -0.1)),
+                                      -10.0);
+        case 7:  return (k < m/2) ? random_below(m/2)           /* partitioned */
+                                  : m/2 + random_below(m-m/2);
+        default: return (random_below(1 << 30) <                /* nearly      */
+                          perturbed * (1 << 30)) ? random_below(m) : k;
+    }
+}
+
+
+/** SORTING ALGORITHMS FOR EACH KEY TYPE ********************************** **/
+
+#define IMPORT_BENCHMARK(type_t, key)                                           \
+                                                                                \
+    IMPORT_HOARE_PARTITION(type_t, LESS_THAN, bench_, _##key)                   \
+    IMPORT_MEDIAN_SORT(type_t, LESS_THAN, 7, bench_hoare_partition_##key,       \
+                       bench_, _##key)                                          \
+    IMPORT_MEDIAN_SORT(type_t, LESS_THAN, 7, block_partition_##key,             \
+                       bench_block_, _##key)                                    \
+    IMPORT_PARALLEL_MEDIAN_SORT(type_t, LESS_THAN, 7, bench_, _##key)           \
+    IMPORT_QUICK_SORT(type_t, LESS_THAN, 7, bench_hoare_partition_##key,        \
+                      bench_, _##key)                                           \
+    IMPORT_QUICK_SORT(type_t, LESS_THAN, 7, block_partition_##key,              \
+                      bench_block_, _##key)                                     \
+    IMPORT_HEAP_SORT(type_t, LESS_THAN, bench_, _##key)                         \
+    IMPORT_SHELL_SORT(type_t, LESS_THAN, bench_, _##key)                        \
+                                                                                \
+    static int compare_##key(const void *i, const void *j) {                    \
+        const type_t x = *(const type_t *) i, y = *(const type_t *) j;          \
+        return (x > y) - (x < y);                                               \
+    }                                                                           \
+                                                                                \
+    static int compare_##key##_r(const void *i, const void *j, void *ctx) {     \
+        (void) ctx;                                                             \
+        return compare_##key(i, j);                                             \
+    }                                                                           \
+                                                                                \
+    static void fill_##key(void *A, const size_t n, const size_t input) {       \
+        size_t i;                                                               \
+        for (i = 0; i < n; ++i) {                                               \
+            ((type_t *) A)[i] = (type_t) input_value(input, i, n);              \
+        }                                                                       \
+    }                                                                           \
+                                                                                \
+    static void run_##key(const size_t algorithm, void *V, const size_t n,      \
+                          const size_t threads) {                               \
+        type_t *A = (type_t *) V;                                               \
+        switch (algorithm) {                                                    \
+            case 0: qsort(A, n, sizeof(type_t), &compare_##key);        break;  \
+            case 1: bench_median_sort_##key(A, n);                      break;  \
+            case 2: bench_block_median_sort_##key(A, n);                break;  \
+            case 3: median_sort_##key(A, n);                            break;  \
+            case 4: median_sort_generic(A, n, sizeof(type_t),                   \
+                                        &compare_##key##_r, NULL);      break;  \
+            case 5: bench_parallel_median_sort_##key(A, n, threads);    break;  \
+            case 6: bench_quick_sort_##key(A, n);                       break;  \
+            case 7: bench_block_quick_sort_##key(A, n);                 break;  \
+            case 8: bench_heap_sort_##key(A, n);                        break;  \
+            case 9: bench_shell_sort_##key(A, n);                       break;  \
+            case 10: bench_adaptive_median_sort_##key(A, n);            break;  \
+        }                                                                       \
+    }                                                                           \
+                                                                                \
+
+IMPORT_BENCHMARK(int32_t, i32)
+IMPORT_BENCHMARK(int64_t, i64)
+IMPORT_BENCHMARK(float,   f32)
+IMPORT_BENCHMARK(double,  f64)
+
+static const size_t key_sizes[KEYS] = {
+    sizeof(int32_t), sizeof(int64_t), sizeof(float), sizeof(double)
+};
+
+static void fill(const size_t key, void *A, const size_t n,
+                 const size_t input) {
+    switch (key) {
+        case 0:  fill_i32(A, n, input); break;
+        case 1:  fill_i64(A, n, input); break;
+        case 2:  fill_f32(A, n, input); break;
+        default: fill_f64(A, n, input); break;
+    }
+}
+
+static void run(const size_t key, const size_t algorithm, void *A,
+                const size_t n, const size_t threads) {
+    switch (key) {
+        case 0:  run_i32(algorithm, A, n, threads); break;
+        case 1:  run_i64(algorithm, A, n, threads); break;
+        case 2:  run_f32(algorithm, A, n, threads); break;
+        default: run_f64(algorithm, A, n, threads); break;
+    }
+}
+
+static void sort_reference(const size_t key, void *A, const size_t n) {
+    run(key, 0, A, n, 1);
+}
+
+
+/** COMMAND LINE ********************************************************** **/
+
+static int parse_names(char *list, const char **names, const size_t count,
+                       int *selected) {
+
+    /* Marks the comma separated names of list (returns 0 on unknown names) */
+    char *name;
+    size_t i;
+
+    for (i = 0; i < count; ++i) { selected[i] = 0; }
+    for (name = strtok(list, ","); name; name = strtok(NULL, ",")) {
+        for (i = 0; i < count && strcmp(name, names[i]) != 0; ++i);
+        if (i == count) {
+            fprintf(stderr, "Unknown name: %s\n", name);
+            return 0;
+        }
+        selected[i] = 1;
+    }
+    return 1;
+}
+
+static size_t parse_sizes(char *list, size_t *sizes) {
+
+    /* Reads the comma separated sizes of list (returns 0 on errors) */
+    char *item, *end;
+    size_t count = 0;
+
+    for (item = strtok(list, ","); item; item = strtok(NULL, ",")) {
+        if (count == MAX_SIZES) { return 0; }
+        sizes[count] = (size_t) strtoull(item, &end, 10);
+        if (*end != '\0' || sizes[count] == 0) { return 0; }
+        ++count;
+    }
+    return count;
+}
+
+
+/** STATISTICS ************************************************************ **/
+
+static int compare_double(const void *i, const void *j) {
+    const double x = *(const double *) i, y = *(const double *) j;
+    return (x > y) - (x < y);
+}
+
+static double percentile(const double *sorted, const size_t n,
+                         const size_t p) {
+
+    /* Nearest rank percentile of n sorted values */
+    size_t rank = (p * n + 99) / 100;
+    return sorted[rank ? rank-1 : 0];
+}
+
+
+/** MAIN ****************************************************************** **/
+
+int main(int argc, char **argv) {
+
+    int    algorithms[ALGORITHMS], keys[KEYS], inputs[INPUTS];
+    size_t sizes[MAX_SIZES] = {1000, 10000, 100000, 1000000};
+    size_t nsizes = 4, repeat = 11, threads, seed = 1, biggest, bytes;
+    size_t a, k, d, s, r, n, records = 0;
+    double start, *times, stats[ALGORITHMS][6];
+    int    option, format = 0;
+    char  *original, *reference, *array;
+
+    const long online = sysconf(_SC_NPROCESSORS_ONLN);
+    threads = online > 0 ? (size_t) online : 1;
+
+    for (a = 0; a < ALGORITHMS; ++a) { algorithms[a] = 1; }
+    for (k = 0; k < KEYS;       ++k) { keys[k]       = (k == 0); }
+    for (d = 0; d < INPUTS;     ++d) { inputs[d]     = (d == 0); }
+
+    /*** READ THE OPTIONS ****************************************************/
+
+    while ((option = getopt(argc, argv, "a:k:d:n:r:s:t:p:f:h")) != -1) {
+        int ok = 1;
+        switch (option) {
+            case 'a': ok = parse_names(optarg, algorithm_names, ALGORITHMS,
+                                       algorithms);                    break;
+            case 'k': ok = parse_names(optarg, key_names, KEYS, keys); break;
+            case 'd': ok = parse_names(optarg, input_names, INPUTS,
+                                       inputs);                        break;
+            case 'n': ok = (nsizes = parse_sizes(optarg, sizes)) > 0;  break;
+            case 'r': ok = (repeat = strtoul(optarg, NULL, 10)) > 0;   break;
+            case 's': seed = strtoul(optarg, NULL, 10);                break;
+            case 't': ok = (threads = strtoul(optarg, NULL, 10)) > 0;  break;
+            case 'p': perturbed = strtod(optarg, NULL);
+                      ok = perturbed >= 0.0 && perturbed <= 1.0;       break;
+            case 'f': if      (!strcmp(optarg, "table")) { format = 0; }
+                      else if (!strcmp(optarg, "csv"))   { format = 1; }
+                      else if (!strcmp(optarg, "json"))  { format = 2; }
+                      else                               { ok = 0;     }
+                      break;
+            default:  ok = 0; break;
+        }
+        if (!ok) { fputs(usage, stderr); return 1; }
+    }
+    if (optind < argc) { fputs(usage, stderr); return 1; }
+
+    /*** ALLOCATE MEMORY *****************************************************/
+
+    for (biggest = 0, s = 0; s < nsizes; ++s) {
+        if (sizes[s] > biggest) { biggest = sizes[s]; }
+    }
+    bytes     = biggest * sizeof(double);
+    original  = (char *) malloc(bytes);                      assert(original);
+    reference = (char *) malloc(bytes);                      assert(reference);
+    array     = (char *) malloc(bytes);                      assert(array);
+    times     = (double *) malloc(ALGORITHMS * repeat * sizeof(double));
+    assert(times);
+
+    /*** RUN THE BENCHMARK ***************************************************/
+
+    if (format == 1) {
+        printf("algorithm,key,input,size,repeat,min_ns,p10_ns,median_ns,"
+               "p90_ns,max_ns,ns_per_element\n");
+    }
+    if (format == 2) { printf("["); }
+
+    for (k = 0; k < KEYS; ++k) {
+        for (d = 0; d < INPUTS; ++d) {
+
+            if (!keys[k] || !inputs[d]) { continue; }
+
+            if (format == 0) {
+                printf("# %s keys, %s input\nSize", key_names[k],
+                       input_names[d]);
+                for (a = 0; a < ALGORITHMS; ++a) {
+                    if (algorithms[a]) { printf(" %s", algorithm_names[a]); }
+                }
+                printf("\n");
+            }
+
+            for (s = 0; s < nsizes; ++s) {
+
+                n = sizes[s];
+                fprintf(stderr, "SORTING %zu %s KEYS (%s)\n", n,
+                        key_names[k], input_names[d]);
+
+                for (r = 0; r < repeat; ++r) {
+
+                    /* Same instance for all the algorithms */
+                    srand((unsigned) (seed + r));
+                    fill(k, original, n, d);
+                    memcpy(reference, original, n * key_sizes[k]);
+                    sort_reference(k, reference, n);
+
+                    for (a = 0; a < ALGORITHMS; ++a) {
+                        if (!algorithms[a]) { continue; }
+                        memcpy(array, original, n * key_sizes[k]);
+                        start = wall_clock();
+                        run(k, a, array, n, threads);
+                        times[a*repeat + r] = wall_clock() - start;
+                        if (memcmp(array, reference, n * key_sizes[k])) {
+                            fprintf(stderr, "%s did not sort the %s keys\n",
+                                    algorithm_names[a], key_names[k]);
+                            return 2;
+                        }
+                    }
+                }
+
+                /* Statistics (in ns) of each algorithm */
+                for (a = 0; a < ALGORITHMS; ++a) {
+                    double *T = times + a*repeat;
+                    if (!algorithms[a]) { continue; }
+                    qsort(T, repeat, sizeof(double), &compare_double);
+                    stats[a][0] = 1e9 * T[0];
+                    stats[a][1] = 1e9 * percentile(T, repeat, 10);
+                    stats[a][2] = 1e9 * percentile(T, repeat, 50);
+                    stats[a][3] = 1e9 * percentile(T, repeat, 90);
+                    stats[a][4] = 1e9 * T[repeat-1];
+                    stats[a][5] = stats[a][2] / (double) n;
+                }
+
+                /* Output */
+                if (format == 0) { printf("%zu", n); }
+                for (a = 0; a < ALGORITHMS; ++a) {
+                    if (!algorithms[a]) { continue; }
+                    fprintf(stderr, "  %-20s median %12.0f ns (p10 %12.0f, "
+                            "p90 %12.0f) = %8.2f ns/element\n",
+                            algorithm_names[a], stats[a][2], stats[a][1],
+                            stats[a][3], stats[a][5]);
+                    if (format == 0 && algorithms[0]) {
+                        printf(" %.2f", 100.0 * stats[a][2] / stats[0][2]);
+                    }
+                    else if (format == 0) {
+                        printf(" %.2f", stats[a][5]);
+                    }
+                    else if (format == 1) {
+                        printf("%s,%s,%s,%zu,%zu,%.0f,%.0f,%.0f,%.0f,%.0f,"
+                               "%.3f\n", algorithm_names[a], key_names[k],
+                               input_names[d], n, repeat, stats[a][0],
+                               stats[a][1], stats[a][2], stats[a][3],
+                               stats[a][4], stats[a][5]);
+                    }
+                    else {
+                        printf("%s\n  {\"algorithm\": \"%s\", \"key\": \"%s\", "
+                               "\"input\": \"%s\", \"size\": %zu, "
+                               "\"repeat\": %zu, \"min_ns\": %.0f, "
+                               "\"p10_ns\": %.0f, \"median_ns\": %.0f, "
+                               "\"p90_ns\": %.0f, \"max_ns\": %.0f, "
+                               "\"ns_per_element\": %.3f}",
+                               records ? "," : "", algorithm_names[a],
+                               key_names[k], input_names[d], n, repeat,
+                               stats[a][0], stats[a][1], stats[a][2],
+                               stats[a][3], stats[a][4], stats[a][5]);
+                        ++records;
+                    }
+                }
+                if (format == 0) { printf("\n"); }
+            }
+            if (format == 0) { printf("\n\n"); }
+        }
+    }
+    if (format == 2) { printf("\n]\n"); }
+
+    free(original);
+    free(reference);
+    free(array);
+    free(times);
+
+    return 0;
+}
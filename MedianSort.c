@@ -41,450 +41,3966 @@
 
 /** LIBRARIES ************************************************************* **/
 
+#define _POSIX_C_SOURCE 200809L  /* Threads, barriers and monotonic clocks.  */
+#ifdef MEDIAN_SORT_INSTRUMENT
+#define _GNU_SOURCE              /* The syscall function (perf_event_open).  */
+#endif
+
 #include <assert.h>     /* Include assertions unless NDEBUG is defined.      */
 #include <stdio.h>      /* Input and output functions.                       */
 #include <stdlib.h>     /* Memory allocation and random functions.           */
 #include <string.h>     /* The size_t type.                                  */
+#include <stddef.h>     /* The offsetof macro.                               */
 #include <time.h>       /* Time functions.                                   */
 #include <math.h>       /* The pow function.                                 */
+#include <pthread.h>    /* Threads and barriers.                             */
+#include <unistd.h>     /* The sysconf and syscall functions.                */
+#include <stdint.h>     /* Fixed width integer types.                        */
+#include <fcntl.h>      /* The open function.                                */
+#include <sys/mman.h>   /* Memory mapped files.                              */
+#include <sys/stat.h>   /* The fstat function.                               */
+
+
+/** INSTRUMENTATION ******************************************************* **/
+
+/* Compile with -DMEDIAN_SORT_INSTRUMENT to count the comparisons and swaps  */
+/* (an insertion sort shift counts as one swap) of IMPORT_MEDIAN_SORT and    */
+/* IMPORT_QUICK_SORT, together with the last level cache misses reported by  */
+/* perf_event_open (when the kernel allows it), per interval size 2^k: every */
+/* quick_select of median_sort and every partition of quick_sort is charged  */
+/* to the smallest 2^k that holds its interval, and the final sorts of the   */
+/* small blocks to a separate "leaves" row. Only the calling thread counts.  */
+/* The miss counter is only read when the row changes (once per level of    */
+/* median_sort), since a read per interval would add misses of its own.      */
+/* Otherwise all these hooks compile to nothing.                             */
+
+#ifdef MEDIAN_SORT_INSTRUMENT
+
+#if defined(__linux__)
+#include <linux/perf_event.h>   /* The perf_event_attr structure.            */
+#include <sys/syscall.h>        /* The perf_event_open system call number.   */
+#endif
+
+#define INSTRUMENT_LEAVES 65    /* Rows 0..64 are interval sizes 2^0..2^64   */
+
+typedef struct {
+    uint64_t calls, elements, comparisons, swaps, misses;
+} instrument_row;
+
+typedef struct {
+    uint64_t       comparisons, swaps;          /* Running counters          */
+    instrument_row row[INSTRUMENT_LEAVES+1];
+    int            perf;                        /* perf_event_open fd or -1  */
+    int            ready;
+    size_t         level;                       /* Row charged with misses   */
+    uint64_t       mark;                        /* Misses when it started    */
+} instrument_table;
+
+static __thread instrument_table instrument;
+
+static inline uint64_t instrument_misses(void) {
+    uint64_t count = 0;
+    if (instrument.perf >= 0 &&
+        read(instrument.perf, &count, sizeof(count)) != sizeof(count)) {
+        count = 0;
+    }
+    return count;
+}
+
+static inline void instrument_reset(void) {
+
+    if (!instrument.ready) {
+        instrument.perf  = -1;
+        instrument.ready = 1;
+        #if defined(__linux__) && defined(SYS_perf_event_open)
+        {
+            struct perf_event_attr attr;
+            memset(&attr, 0, sizeof(attr));
+            attr.type           = PERF_TYPE_HARDWARE;
+            attr.size           = sizeof(attr);
+            attr.config         = PERF_COUNT_HW_CACHE_MISSES;
+            attr.exclude_kernel = 1;
+            attr.exclude_hv     = 1;
+            instrument.perf = (int) syscall(SYS_perf_event_open, &attr,
+                                            0, -1, -1, 0);
+        }
+        #endif
+    }
+    memset(instrument.row, 0, sizeof(instrument.row));
+    instrument.comparisons = instrument.swaps = 0;
+    instrument.level       = INSTRUMENT_LEAVES+1;
+}
+
+/* Row of an interval of the given length (or of a leaf sort) */
+static inline size_t instrument_row_of(const size_t length, const int leaves) {
+    size_t k;
+    for (k = 0; k < INSTRUMENT_LEAVES-1 && ((size_t) 1 << k) < length; ++k);
+    return leaves ? INSTRUMENT_LEAVES : k;
+}
+
+/* Charges the misses since the last change of row to that row */
+static inline void instrument_level(const size_t k) {
+    uint64_t now;
+    if (k == instrument.level) { return; }
+    now = instrument_misses();
+    if (instrument.level <= INSTRUMENT_LEAVES) {
+        instrument.row[instrument.level].misses += now - instrument.mark;
+    }
+    instrument.level = k;
+    instrument.mark  = now;
+}
+
+static inline void instrument_end(const size_t length, const int leaves,
+                                  const uint64_t comparisons,
+                                  const uint64_t swaps) {
+
+    instrument_row *row = &instrument.row[instrument_row_of(length, leaves)];
+
+    row->calls       += 1;
+    row->elements    += length;
+    row->comparisons += comparisons;
+    row->swaps       += swaps;
+}
+
+/* Prints the table of the counts since the last instrument_reset() */
+static inline void instrument_report(FILE *out, const char *name) {
+
+    const instrument_row *row;
+    instrument_row total;
+    char   label[8];
+    size_t i, k;
+
+    instrument_level(INSTRUMENT_LEAVES+1);
+    memset(&total, 0, sizeof(total));
+    fprintf(out, "\n%s\n", name);
+    fprintf(out, "%8s %10s %12s %14s %8s %14s %8s %12s %8s\n", "level",
+            "calls", "elements", "comparisons", "per elt", "swaps", "per elt",
+            "LLC misses", "per elt");
+    for (i = 0; i <= INSTRUMENT_LEAVES; ++i) {
+        k   = i < INSTRUMENT_LEAVES ? INSTRUMENT_LEAVES-1-i : INSTRUMENT_LEAVES;
+        row = &instrument.row[k];
+        if (row->calls == 0) { continue; }
+        if (k == INSTRUMENT_LEAVES) { strcpy(label, "leaves"); }
+        else                        { sprintf(label, "2^%zu", k); }
+        fprintf(out, "%8s %10llu %12llu %14llu %8.2f %14llu %8.2f", label,
+                (unsigned long long) row->calls,
+                (unsigned long long) row->elements,
+                (unsigned long long) row->comparisons,
+                (double) row->comparisons / (double) row->elements,
+                (unsigned long long) row->swaps,
+                (double) row->swaps / (double) row->elements);
+        if (instrument.perf >= 0) {
+            fprintf(out, " %12llu %8.4f\n", (unsigned long long) row->misses,
+                    (double) row->misses / (double) row->elements);
+        } else {
+            fprintf(out, " %12s %8s\n", "n/a", "n/a");
+        }
+        total.calls       += row->calls;
+        total.comparisons += row->comparisons;
+        total.swaps       += row->swaps;
+        total.misses      += row->misses;
+    }
+    fprintf(out, "%8s %10llu %12s %14llu %8s %14llu %8s", "total",
+            (unsigned long long) total.calls, "",
+            (unsigned long long) total.comparisons, "",
+            (unsigned long long) total.swaps, "");
+    if (instrument.perf >= 0) {
+        fprintf(out, " %12llu\n", (unsigned long long) total.misses);
+    } else {
+        fprintf(out, " %12s\n", "n/a");
+    }
+}
+
+#define COUNT_COMPARISON(c) (++instrument.comparisons, (c))
+#define COUNT_SWAPS(n)      ((void) (instrument.swaps += (uint64_t) (n)))
+
+#define INSTRUMENT_BEGIN(length, leaves)                                        \
+    const uint64_t instrument_comparisons = instrument.comparisons;             \
+    const uint64_t instrument_swaps       = instrument.swaps;                   \
+    instrument_level(instrument_row_of((length), (leaves)))
+
+#define INSTRUMENT_END(length, leaves)                                          \
+    instrument_end((length), (leaves),                                          \
+                   instrument.comparisons - instrument_comparisons,             \
+                   instrument.swaps       - instrument_swaps)
+
+#else
+
+#define COUNT_COMPARISON(c) (c)
+#define COUNT_SWAPS(n)      ((void) 0)
+#define INSTRUMENT_BEGIN(length, leaves) ((void) 0)
+#define INSTRUMENT_END(length, leaves)   ((void) 0)
+
+#endif
 
 
 /** GENERIC SORTING FUNCTION TEMPLATES ************************************ **/
 
-#define LESS_THAN(i, j) ((i) < (j))
+#define LESS_THAN(i, j) COUNT_COMPARISON((i) < (j))
+
+/* Partition templates: partition(A, length, pivot, &lo, &hi) rearranges A   */
+/* around the value of A[pivot], so that A[0,lo) <= A[lo,hi) == A[pivot] <=  */
+/* A[hi,length) with 0 < hi and lo < length. Any of them can be used by      */
+/* IMPORT_MEDIAN_SORT and IMPORT_QUICK_SORT (fat_partition returns the whole */
+/* run of copies of the pivot, which pays off when there are few distinct    */
+/* keys).                                                                    */
 
-#define IMPORT_MEDIAN_SORT(type_t, less_than, power, prefix, suffix)            \
+#define IMPORT_HOARE_PARTITION(type_t, less_than, prefix, suffix)               \
                                                                                 \
-    static void prefix##quick_select##suffix(type_t *A, const size_t length,    \
-                                             const size_t rank) {               \
+    static void prefix##hoare_partition##suffix(type_t *A, const size_t length, \
+                                                const size_t pivot,             \
+                                                size_t *lo, size_t *hi) {       \
                                                                                 \
-        size_t l, left  = 0;                                                    \
-        size_t r, right = length-1;                                             \
-        type_t t, pivot;                                                        \
+        const type_t p = A[pivot];                                              \
                                                                                 \
-        while (left < right) {                                                  \
-            pivot = A[rank];                                                    \
-            l     = left;                                                       \
-            r     = right;                                                      \
-            do {while (less_than(A[l], pivot)) { ++l; }                         \
-                while (less_than(pivot, A[r])) { --r; }                         \
-                if (l <= r) { t=A[l]; A[l]=A[r]; A[r]=t; ++l; --r; }            \
-            } while (l <= r);                                                   \
-            if (r < rank) { left  = l; }                                        \
-            if (rank < l) { right = r; }                                        \
-        }                                                                       \
+        size_t l = 0, h = length;                                               \
+        type_t t;                                                               \
+                                                                                \
+        do {while (less_than(A[l], p))   { ++l; }                               \
+            while (less_than(p, A[h-1])) { --h; }                               \
+            if (l < h) { --h; t=A[l]; A[l]=A[h]; A[h]=t; ++l; COUNT_SWAPS(1); } \
+        } while (l < h);                                                        \
+                                                                                \
+        *lo = h;                                                                \
+        *hi = l;                                                                \
     }                                                                           \
                                                                                 \
-    static void prefix##median_sort##suffix(type_t *A, const size_t length) {   \
+
+#define BLOCK_SIZE 64
+
+#define IMPORT_BLOCK_PARTITION(type_t, less_than, prefix, suffix)               \
                                                                                 \
-        const size_t MIN_SIZE = 1 << power;                                     \
+    static void prefix##block_partition##suffix(type_t *A, const size_t length, \
+                                                const size_t pivot,             \
+                                                size_t *lo, size_t *hi) {       \
                                                                                 \
-        size_t l, r, rank, step;                                                \
-        type_t t;                                                               \
+        unsigned char offsets_l[BLOCK_SIZE], offsets_r[BLOCK_SIZE];             \
                                                                                 \
-        /* MEDIAN SORT (down to 2^(power+1) intervals) */                       \
-        for (step   = 1; step <  length;   step <<= 1);                         \
-        for (step >>= 1; step >= MIN_SIZE; step >>= 1) {                        \
-            for (rank = step; rank < length; rank += (step << 1)) {             \
-                l = (rank-step);                                                \
-                r = (rank+step) > length ? length : (rank+step);                \
+        size_t i, n, num_l = 0, num_r = 0, start_l = 0, start_r = 0;            \
+        size_t l = 0, r = length-1;                                             \
+        type_t t, p;                                                            \
                                                                                 \
-                /* QUICK SELECT rank in the interval [l, r) */                  \
-                prefix##quick_select##suffix(A+l, r-l, step);                   \
+        /* Keep the pivot at the end */                                         \
+        p = A[pivot]; A[pivot] = A[r]; A[r] = p; COUNT_SWAPS(1);                \
+                                                                                \
+        /* BLOCK PARTITION (while there are two disjoint blocks in [l, r)) */   \
+        while (r - l > 2 * BLOCK_SIZE) {                                        \
+                                                                                \
+            /* Find (without branches) the misplaced elements of each block */  \
+            if (num_l == 0) {                                                   \
+                for (start_l = 0, i = 0; i < BLOCK_SIZE; ++i) {                 \
+                    offsets_l[num_l] = (unsigned char) i;                       \
+                    num_l += !less_than(A[l+i], p);                             \
+                }                                                               \
+            }                                                                   \
+            if (num_r == 0) {                                                   \
+                for (start_r = 0, i = 0; i < BLOCK_SIZE; ++i) {                 \
+                    offsets_r[num_r] = (unsigned char) i;                       \
+                    num_r += !less_than(p, A[r-1-i]);                           \
+                }                                                               \
+            }                                                                   \
+                                                                                \
+            /* Swap them in bulk */                                             \
+            n = num_l < num_r ? num_l : num_r; COUNT_SWAPS(n);                  \
+            for (i = 0; i < n; ++i) {                                           \
+                t                                = A[l+offsets_l[start_l+i]];   \
+                A[l+offsets_l[start_l+i]]        = A[r-1-offsets_r[start_r+i]]; \
+                A[r-1-offsets_r[start_r+i]]      = t;                           \
             }                                                                   \
+            num_l -= n; start_l += n; if (num_l == 0) { l += BLOCK_SIZE; }      \
+            num_r -= n; start_r += n; if (num_r == 0) { r -= BLOCK_SIZE; }      \
         }                                                                       \
                                                                                 \
-        /* INSERTION SORT (up to 2^(power+1) distances) */                      \
-        if (MIN_SIZE > 1) {                                                     \
-            for (r = 1; r < length; ++r) {                                      \
-                t = A[r];                                                       \
-                for (l=r; l && less_than(t, A[l-1]); --l) { A[l] = A[l-1]; }    \
-                A[l] = t;                                                       \
+        /* HOARE PARTITION (of the remaining elements) */                       \
+        for (;;) {                                                              \
+            while (l < r && less_than(A[l],   p)) { ++l; }                      \
+            while (l < r && less_than(p, A[r-1])) { --r; }                      \
+            if (l >= r) { break; }                                              \
+            --r; t = A[l]; A[l] = A[r]; A[r] = t; ++l; COUNT_SWAPS(1);          \
+        }                                                                       \
+                                                                                \
+        /* Put the pivot in its place */                                        \
+        A[length-1] = A[l]; A[l] = p; COUNT_SWAPS(1);                           \
+                                                                                \
+        *lo = l;                                                                \
+        *hi = l+1;                                                              \
+    }                                                                           \
+                                                                                \
+
+#define IMPORT_FAT_PARTITION(type_t, less_than, prefix, suffix)                 \
+                                                                                \
+    static void prefix##fat_partition##suffix(type_t *A, const size_t length,   \
+                                              const size_t pivot,               \
+                                              size_t *lo, size_t *hi) {         \
+                                                                                \
+        size_t a = 1, b = 1, c = length-1, d = length-1, i, n;                  \
+        type_t t, p;                                                            \
+                                                                                \
+        /* Keep the pivot at the front */                                       \
+        p = A[pivot]; A[pivot] = A[0]; A[0] = p; COUNT_SWAPS(1);                \
+                                                                                \
+        /* BENTLEY-MCILROY PARTITION (= p | < p | > p | = p) */                 \
+        for (;;) {                                                              \
+            while (b <= c && !less_than(p, A[b])) {                             \
+                if (!less_than(A[b], p)) {                                      \
+                    t=A[a]; A[a]=A[b]; A[b]=t; ++a; COUNT_SWAPS(1);             \
+                }                                                               \
+                ++b;                                                            \
+            }                                                                   \
+            while (b <= c && !less_than(A[c], p)) {                             \
+                if (!less_than(p, A[c])) {                                      \
+                    t=A[c]; A[c]=A[d]; A[d]=t; --d; COUNT_SWAPS(1);             \
+                }                                                               \
+                --c;                                                            \
             }                                                                   \
+            if (b > c) { break; }                                               \
+            t = A[b]; A[b] = A[c]; A[c] = t; ++b; --c; COUNT_SWAPS(1);          \
         }                                                                       \
+                                                                                \
+        /* Move the copies of the pivot from both ends to the middle */         \
+        n = a < b-a ? a : b-a; COUNT_SWAPS(n);                                  \
+        for (i = 0; i < n; ++i) {                                               \
+            t = A[i]; A[i] = A[b-n+i]; A[b-n+i] = t;                            \
+        }                                                                       \
+        n = d-c < length-1-d ? d-c : length-1-d; COUNT_SWAPS(n);                \
+        for (i = 0; i < n; ++i) {                                               \
+            t = A[b+i]; A[b+i] = A[length-n+i]; A[length-n+i] = t;              \
+        }                                                                       \
+                                                                                \
+        *lo = b - a;                                                            \
+        *hi = length - (d - c);                                                 \
     }                                                                           \
                                                                                 \
 
-#define IMPORT_QUICK_SORT(type_t, less_than, power, prefix, suffix)             \
+/* After the last level, median_sort sorts every block of 2^power elements   */
+/* on its own: blocks of at least NETWORK_SIZE elements go through a bitonic */
+/* sorting network (branch-free whenever less_than compiles to conditional   */
+/* moves, as it does for integers) and shorter ones through insertion sort.  */
+
+#define NETWORK_SIZE 128
+
+/* Once an interval of the median sort fits in CACHE_SIZE bytes (about the   */
+/* size of the L2 cache), its whole subtree is finished before moving on to  */
+/* the next one, so that large arrays are not streamed from memory once per  */
+/* level. cached_median_sort(A, length, 0) is the plain breadth-first order. */
+
+#ifndef CACHE_SIZE
+#define CACHE_SIZE (1 << 18)
+#endif
+
+#define IMPORT_MEDIAN_SORT(type_t, less_than, power, partition, prefix, suffix) \
                                                                                 \
-    static void prefix##quick_sort##suffix(type_t *A, const size_t length) {    \
+    static void prefix##quick_select##suffix(type_t *A, const size_t length,    \
+                                             const size_t rank);                \
+                                                                                \
+    static size_t prefix##median_of_medians##suffix(type_t *A,                  \
+                                                    const size_t length) {      \
+                                                                                \
+        size_t i, j, k, groups = length / 5;                                    \
+        type_t t;                                                               \
+                                                                                \
+        /* Move the median of each group of 5 elements to the front */          \
+        for (i = 0; i < groups; ++i) {                                          \
+            for (j = 5*i+1; j < 5*i+5; ++j) {                                   \
+                t = A[j];                                                       \
+                for (k=j; k > 5*i && less_than(t, A[k-1]); --k) {               \
+                    A[k] = A[k-1]; COUNT_SWAPS(1);                              \
+                }                                                               \
+                A[k] = t;                                                       \
+            }                                                                   \
+            t = A[i]; A[i] = A[5*i+2]; A[5*i+2] = t; COUNT_SWAPS(1);            \
+        }                                                                       \
+                                                                                \
+        /* QUICK SELECT the median of the medians */                            \
+        prefix##quick_select##suffix(A, groups, groups/2);                      \
+        return groups/2;                                                        \
+    }                                                                           \
+                                                                                \
+    static void prefix##quick_select##suffix(type_t *A, const size_t length,    \
+                                             const size_t rank) {               \
+                                                                                \
+        size_t pivot, lo, hi, size;                                             \
+        size_t left  = 0;                                                       \
+        size_t right = length;                                                  \
+        size_t limit = 16;                                                      \
+                                                                                \
+        while (right-left > 1) {                                                \
+            size  = right-left;                                                 \
+            pivot = rank;                                                       \
+                                                                                \
+            /* Near an end, pivot past the mirror image of rank to split    */  \
+            /* that end off (on presorted input A[rank] is a few places off */  \
+            /* and would only trim one or two elements per round)           */  \
+            if (rank-left < size/8) {                                           \
+                pivot = rank + (rank-left) + size/16;                           \
+            } else if (right-rank <= size/8) {                                  \
+                pivot = rank - (right-1-rank) - size/16;                        \
+            }                                                                   \
+            if (!limit && size >= 32) {                                         \
+                pivot = left + prefix##median_of_medians##suffix(A+left, size); \
+            }                                                                   \
+            partition(A+left, size, pivot-left, &lo, &hi);                      \
+            lo += left;                                                         \
+            hi += left;                                                         \
+                                                                                \
+            /* After 16 unbalanced rounds use the median of medians pivot */    \
+            if (limit && (lo-left < size/8 || right-hi < size/8)) { --limit; }  \
                                                                                 \
+            if      (rank <  lo) { right = lo; }                                \
+            else if (rank >= hi) { left  = hi; }                                \
+            else                 { return;     }                                \
+        }                                                                       \
+    }                                                                           \
+                                                                                \
+    static inline void prefix##network_sort##suffix(type_t *A,                  \
+                                                    const size_t length) {      \
+                                                                                \
+        size_t i, j, k, n, p;                                                   \
+        type_t x, y;                                                            \
+        int    c;                                                               \
+                                                                                \
+        /* BITONIC SORT (missing keys act as +infinity, so they never move) */  \
+        for (p = 1; p < length; p <<= 1) {                                      \
+            for (j = 0; j + p < length; j += (p << 1)) {                        \
+                n = j + (p << 1) > length ? length - j - p : p;                 \
+                for (i = p - n; i < p; ++i) {                                   \
+                    x = A[j+i];                                                 \
+                    y = A[j+(p<<1)-1-i];                                        \
+                    c = less_than(y, x); COUNT_SWAPS(c);                        \
+                    A[j+i]          = c ? y : x;                                \
+                    A[j+(p<<1)-1-i] = c ? x : y;                                \
+                }                                                               \
+            }                                                                   \
+            for (k = p >> 1; k > 0; k >>= 1) {                                  \
+                for (j = 0; j + k < length; j += (k << 1)) {                    \
+                    n = j + (k << 1) > length ? length - j - k : k;             \
+                    for (i = 0; i < n; ++i) {                                   \
+                        x = A[j+i];                                             \
+                        y = A[j+k+i];                                           \
+                        c = less_than(y, x); COUNT_SWAPS(c);                    \
+                        A[j+i]   = c ? y : x;                                   \
+                        A[j+k+i] = c ? x : y;                                   \
+                    }                                                           \
+                }                                                               \
+            }                                                                   \
+        }                                                                       \
+    }                                                                           \
+                                                                                \
+    static inline void prefix##insertion_sort##suffix(type_t *A,                \
+                                                      const size_t length) {    \
         size_t l, r;                                                            \
         type_t t;                                                               \
                                                                                 \
-        /* QUICK SORT (down to 2^power intervals) */                            \
-        if (length > (1 << power)) {                                            \
+        for (r = 1; r < length; ++r) {                                          \
+            t = A[r];                                                           \
+            for (l=r; l && less_than(t, A[l-1]); --l) {                         \
+                A[l] = A[l-1]; COUNT_SWAPS(1);                                  \
+            }                                                                   \
+            A[l] = t;                                                           \
+        }                                                                       \
+    }                                                                           \
+                                                                                \
+    static inline void prefix##leaf_sort##suffix(type_t *A,                     \
+                                                 const size_t length) {         \
+        if (length >= NETWORK_SIZE) {                                           \
+            prefix##network_sort##suffix(A, length);                            \
+        } else {                                                                \
+            prefix##insertion_sort##suffix(A, length);                          \
+        }                                                                       \
+    }                                                                           \
+                                                                                \
+    /* An interval [l, r) is enclosed by A[l-1] <= A[l, r) <= A[r], so it   */  \
+    /* holds a single value (and can be skipped) whenever A[l-1] == A[r]    */  \
+    static inline size_t prefix##select_interval##suffix(type_t *A,             \
+                                                         const size_t length,   \
+                                                         const size_t l,        \
+                                                         const size_t r,        \
+                                                         const size_t rank) {   \
+        if (l > 0 && r < length && !less_than(A[l-1], A[r])) { return 0; }      \
+        INSTRUMENT_BEGIN(r-l, 0);                                               \
+        prefix##quick_select##suffix(A+l, r-l, rank-l);                         \
+        INSTRUMENT_END(r-l, 0);                                                 \
+        return r-l;                                                             \
+    }                                                                           \
+                                                                                \
+    static inline size_t prefix##sort_interval##suffix(type_t *A,               \
+                                                       const size_t length,     \
+                                                       const size_t l,          \
+                                                       const size_t r) {        \
+        if (l > 0 && r < length && !less_than(A[l-1], A[r])) { return 0; }      \
+        INSTRUMENT_BEGIN(r-l, 1);                                               \
+        prefix##leaf_sort##suffix(A+l, r-l);                                    \
+        INSTRUMENT_END(r-l, 1);                                                 \
+        return r-l;                                                             \
+    }                                                                           \
+                                                                                \
+    /* Adaptive mode: an interval that is already split at its rank, that   */  \
+    /* is A[l, rank) <= A[rank] <= A(rank, r), needs no quick_select (the   */  \
+    /* test stops at the first misplaced element) and a block with at most  */  \
+    /* 1/16 of descents A[i] < A[i-1] is finished by insertion sort (or     */  \
+    /* skipped, if it has none)                                             */  \
+    static inline size_t prefix##adaptive_select_interval##suffix(              \
+            type_t *A, const size_t length,                                     \
+            const size_t l, const size_t r, const size_t rank) {                \
+                                                                                \
+        size_t i;                                                               \
+                                                                                \
+        if (l > 0 && r < length && !less_than(A[l-1], A[r])) { return 0; }      \
+        for (i = l; i < rank && !less_than(A[rank], A[i]); ++i);                \
+        if (i == rank) {                                                        \
+            for (i = rank+1; i < r && !less_than(A[i], A[rank]); ++i);          \
+            if (i == r) { return 0; }                                           \
+        }                                                                       \
+        return prefix##select_interval##suffix(A, length, l, r, rank);          \
+    }                                                                           \
+                                                                                \
+    static inline size_t prefix##adaptive_sort_interval##suffix(                \
+            type_t *A, const size_t length,                                     \
+            const size_t l, const size_t r) {                                   \
+                                                                                \
+        size_t i, descents = 0;                                                 \
+                                                                                \
+        for (i = l+1; i < r && descents <= (r-l) / 16; ++i) {                   \
+            descents += less_than(A[i], A[i-1]);                                \
+        }                                                                       \
+        if (descents == 0)          { return 0; }                               \
+        if (descents > (r-l) / 16) {                                            \
+            return prefix##sort_interval##suffix(A, length, l, r);              \
+        }                                                                       \
+        INSTRUMENT_BEGIN(r-l, 1);                                               \
+        prefix##insertion_sort##suffix(A+l, r-l);                               \
+        INSTRUMENT_END(r-l, 1);                                                 \
+        return r-l;                                                             \
+    }                                                                           \
+                                                                                \
+    static void prefix##range_median_sort##suffix(type_t *A,                    \
+                                                  const size_t length,          \
+                                                  const size_t lo,              \
+                                                  const size_t hi,              \
+                                                  const size_t cache,           \
+                                                  const int adaptive) {         \
+                                                                                \
+        const size_t MIN_SIZE = 1 << power;                                     \
+        const size_t MAX_STEP = cache / (2 * sizeof(type_t));                   \
+                                                                                \
+        size_t l, r, b, e, f, rank, step, top;                                  \
+                                                                                \
+        if (length < 2 || lo >= hi) { return; }                                 \
                                                                                 \
-            const type_t pivot = A[length/2];                                   \
+        /* MEDIAN SORT (breadth-first while the intervals exceed the cache) */  \
+        for (top   = 1; top <  length;   top <<= 1);                            \
+        for (top >>= 1; top >= MIN_SIZE && top > MAX_STEP; top >>= 1) {         \
+            for (rank = top + lo / (top << 1) * (top << 1);                     \
+                 rank < length && rank-top < hi; rank += (top << 1)) {          \
+                l = (rank-top);                                                 \
+                r = (rank+top) > length ? length : (rank+top);                  \
                                                                                 \
-            for (l = 0, r = length-1; ; ++l, --r) {                             \
-                while (less_than(A[l], pivot)) { ++l; }                         \
-                while (less_than(pivot, A[r])) { --r; }                         \
-                if (l >= r) { break; }                                          \
-                t = A[l]; A[l] = A[r]; A[r] = t;                                \
+                /* QUICK SELECT rank in the interval [l, r) */                  \
+                if (adaptive) {                                                 \
+                    prefix##adaptive_select_interval##suffix(A, length,         \
+                                                             l, r, rank);       \
+                } else {                                                        \
+                    prefix##select_interval##suffix(A, length, l, r, rank);     \
+                }                                                               \
             }                                                                   \
+        }                                                                       \
                                                                                 \
-            prefix##quick_sort##suffix(A,   l);                                 \
-            prefix##quick_sort##suffix(A+l, length-l);                          \
+        /* Already sorted (only when power is 0) */                             \
+        if (top == 0) { return; }                                               \
+                                                                                \
+        /* MEDIAN SORT (depth-first, one cached subtree [b, e) at a time) */    \
+        for (b = lo / (top << 1) * (top << 1); b < length && b < hi; b = e) {   \
+            e = (b + (top << 1)) > length ? length : (b + (top << 1));          \
+            f = lo > b ? lo : b;                                                \
+            for (step = top; step >= MIN_SIZE; step >>= 1) {                    \
+                for (rank = step + f / (step << 1) * (step << 1);               \
+                     rank < e && rank-step < hi; rank += (step << 1)) {         \
+                    l = (rank-step);                                            \
+                    r = (rank+step) > e ? e : (rank+step);                      \
+                                                                                \
+                    /* QUICK SELECT rank in the interval [l, r) */              \
+                    if (adaptive) {                                             \
+                        prefix##adaptive_select_interval##suffix(A, length,     \
+                                                                 l, r, rank);   \
+                    } else {                                                    \
+                        prefix##select_interval##suffix(A, length,              \
+                                                        l, r, rank);            \
+                    }                                                           \
+                }                                                               \
+            }                                                                   \
+                                                                                \
+            /* LEAF SORT (each block of 2^power elements on its own) */         \
+            for (l = f / MIN_SIZE * MIN_SIZE; MIN_SIZE > 1 && l < e && l < hi;  \
+                 l += MIN_SIZE) {                                               \
+                r = (l + MIN_SIZE) > e ? e : (l + MIN_SIZE);                    \
+                if (adaptive) {                                                 \
+                    prefix##adaptive_sort_interval##suffix(A, length, l, r);    \
+                } else {                                                        \
+                    prefix##sort_interval##suffix(A, length, l, r);             \
+                }                                                               \
+            }                                                                   \
         }                                                                       \
+    }                                                                           \
                                                                                 \
-        /* INSERTION SORT (up to 2^power distances) */                          \
-        else {                                                                  \
-            for (r = 1; r < length; ++r) {                                      \
-                t = A[r];                                                       \
-                for (l=r; l && less_than(t, A[l-1]); --l) { A[l] = A[l-1]; }    \
-                A[l] = t;                                                       \
+    static inline void prefix##cached_median_sort##suffix(type_t *A,            \
+                                                          const size_t length,  \
+                                                          const size_t cache) { \
+        prefix##range_median_sort##suffix(A, length, 0, length, cache, 0);      \
+    }                                                                           \
+                                                                                \
+    static void prefix##median_sort##suffix(type_t *A, const size_t length) {   \
+        prefix##range_median_sort##suffix(A, length, 0, length, CACHE_SIZE, 0); \
+    }                                                                           \
+                                                                                \
+    static inline void prefix##adaptive_median_sort##suffix(                    \
+            type_t *A, const size_t length) {                                   \
+        size_t i;                                                               \
+        type_t t;                                                               \
+                                                                                \
+        /* RUN DETECTION (sorted or reversed input takes a single pass) */      \
+        for (i = 1; i < length && !less_than(A[i], A[i-1]); ++i);               \
+        if (i >= length) { return; }                                            \
+        for (i = 1; i < length && !less_than(A[i-1], A[i]); ++i);               \
+        if (i >= length) {                                                      \
+            for (i = 0; i < length/2; ++i) {                                    \
+                t = A[i]; A[i] = A[length-1-i]; A[length-1-i] = t;              \
             }                                                                   \
+            return;                                                             \
         }                                                                       \
+        prefix##range_median_sort##suffix(A, length, 0, length, CACHE_SIZE, 1); \
     }                                                                           \
                                                                                 \
-
-#define IMPORT_HEAP_SORT(type_t, less_than, prefix, suffix)                     \
+    static inline void prefix##median_partial_sort##suffix(type_t *A,           \
+                                                           const size_t length, \
+                                                           const size_t lo,     \
+                                                           const size_t hi) {   \
+        prefix##range_median_sort##suffix(A, length, lo,                        \
+                                          hi > length ? length : hi,            \
+                                          CACHE_SIZE, 0);                       \
+    }                                                                           \
                                                                                 \
-    static void prefix##heap_sort##suffix(type_t *A, const size_t length) {     \
+    static inline size_t prefix##median_quantiles##suffix(type_t *A,            \
+                                                          const size_t length,  \
+                                                          size_t *ranks,        \
+                                                          const size_t k) {     \
                                                                                 \
-        size_t i, j, k;                                                         \
-        type_t temp;                                                            \
+        const size_t MIN_SIZE = 1 << power;                                     \
                                                                                 \
-        for (i = (length>>1); i--> 0; ) {                                       \
-            temp = A[i];                                                        \
-            for (j = i, k = (i<<1)+1; k < length; k = (j<<1)+1) {               \
-                if (k+1 < length && less_than(A[k], A[k+1])) { ++k; }           \
-                if (less_than(temp, A[k])) { A[j] = A[k]; j = k; }              \
-                else                       { break;              }              \
+        size_t i, j, n, l, r, t, w, step, top, touches = 0;                     \
+                                                                                \
+        /* Sort the ranks (in place) and drop the ones out of range */          \
+        for (i = 1; i < k; ++i) {                                               \
+            t = ranks[i];                                                       \
+            for (j=i; j && t < ranks[j-1]; --j) { ranks[j] = ranks[j-1]; }      \
+            ranks[j] = t;                                                       \
+        }                                                                       \
+        for (n = k; n && ranks[n-1] >= length; --n);                            \
+        if (n == 0 || length < 2) { return 0; }                                 \
+                                                                                \
+        /* MEDIAN SORT (only the intervals that hold some requested rank) */    \
+        for (top = 1; top < length; top <<= 1);                                 \
+        for (top >>= 1, step = top; step >= MIN_SIZE; step >>= 1) {             \
+            for (i = 0; i < n; i = j) {                                         \
+                l = ranks[i] / (step << 1) * (step << 1);                       \
+                r = (l + (step << 1)) > length ? length : (l + (step << 1));    \
+                for (j = i+1; j < n && ranks[j] < r; ++j);                      \
+                                                                                \
+                /* Skip the ranks that were pinned by a previous level */       \
+                w = step << 2;                                                  \
+                if (step < top && ranks[i] == ranks[j-1] &&                     \
+                    (i == 0 || ranks[i-1] / w != l / w) &&                      \
+                    (j == n || ranks[j]   / w != l / w)) { continue; }          \
+                                                                                \
+                /* QUICK SELECT the only rank or the median of [l, r) */        \
+                if (ranks[i] == ranks[j-1]) {                                   \
+                    touches += prefix##select_interval##suffix(A, length,       \
+                                                               l, r, ranks[i]); \
+                } else if (l+step < length) {                                   \
+                    touches += prefix##select_interval##suffix(A, length,       \
+                                                               l, r, l+step);   \
+                }                                                               \
             }                                                                   \
-            A[j] = temp;                                                        \
         }                                                                       \
                                                                                 \
-        for (i = length; i--> 1; ) {                                            \
-            temp = A[i];                                                        \
-            A[i] = A[0];                                                        \
-            for (j = 0, k = 1; k < i; k = (j<<1)+1) {                           \
-                if (k+1 < i && less_than(A[k], A[k+1])) { ++k; }                \
-                if (less_than(temp, A[k])) { A[j] = A[k]; j = k; }              \
-                else                       { break;              }              \
+        /* LEAF SORT (only the blocks that still hold several ranks) */         \
+        for (i = 0; MIN_SIZE > 1 && i < n; i = j) {                             \
+            l = ranks[i] / MIN_SIZE * MIN_SIZE;                                 \
+            r = (l + MIN_SIZE) > length ? length : (l + MIN_SIZE);              \
+            for (j = i+1; j < n && ranks[j] < r; ++j);                          \
+                                                                                \
+            /* Skip the ranks that were pinned by the last level */             \
+            w = MIN_SIZE << 1;                                                  \
+            if (MIN_SIZE <= top && ranks[i] == ranks[j-1] &&                    \
+                (i == 0 || ranks[i-1] / w != l / w) &&                          \
+                (j == n || ranks[j]   / w != l / w)) { continue; }              \
+            if (ranks[i] == ranks[j-1]) {                                       \
+                touches += prefix##select_interval##suffix(A, length,           \
+                                                           l, r, ranks[i]);     \
+            } else {                                                            \
+                touches += prefix##sort_interval##suffix(A, length, l, r);      \
             }                                                                   \
-            A[j] = temp;                                                        \
         }                                                                       \
+        return touches;                                                         \
     }                                                                           \
                                                                                 \
-
-#define IMPORT_SHELL_SORT(type_t, less_than, prefix, suffix)                    \
+    typedef struct {                                                            \
+        type_t *A;                                                              \
+        size_t  length;                                                         \
+        size_t  l;              /* Left end of the next interval         */     \
+        size_t  w;              /* Width of the next interval            */     \
+        size_t  W;              /* Width of the whole interval tree      */     \
+    } prefix##median_state##suffix;                                             \
                                                                                 \
-    static void prefix##shell_sort##suffix(type_t *A, const size_t length) {    \
+    static inline void prefix##median_sort_begin##suffix(                       \
+            prefix##median_state##suffix *S,                                    \
+            type_t *A, const size_t length) {                                   \
+        S->A      = A;                                                          \
+        S->length = length;                                                     \
+        S->l      = length < 2 ? length : 0;                                    \
+        for (S->W = 1; S->W < length; S->W <<= 1);                              \
+        S->w      = S->W;                                                       \
+    }                                                                           \
                                                                                 \
-        /* The first 54 gaps of Tokuda's sequence: ceil((9*((9/4)^n)-4)/5) */   \
-        /* Enough for 64 bit machines. Pre-computed for efficiency.        */   \
-        const size_t gaps[54] = {1u, 4u, 9u, 20u, 46u, 103u, 233u, 525u, 1182u, \
-                                 2660u, 5985u, 13467u, 30301u, 68178u, 153401u, \
-                                 345152u, 776591u, 1747331u, 3931496u,          \
-                                 8845866u, 19903198u, 44782196u, 100759940u,    \
-                                 226709866u, 510097200u, 1147718700u,           \
-                                 2582367076u, 5810325920u, 13073233321u,        \
-                                 29414774973u, 66183243690u, 148912298303u,     \
-                                 335052671183u, 753868510162u, 1696204147864u,  \
-                                 3816459332694u, 8587033498562u,                \
-                                 19320825371765u, 43471857086472u,              \
-                                 97811678444563u, 220076276500268u,             \
-                                 495171622125603u, 1114136149782608u,           \
-                                 2506806337010868u, 5640314258274455u,          \
-                                 12690707081117524u, 28554090932514432u,        \
-                                 64246704598157464u, 144555085345854304u,       \
-                                 325248942028172160u, 731810119563387392u,      \
-                                 1646572769017621760u, 3704788730289648640u,    \
-                                 8335774643151711232u };                        \
+    static inline size_t prefix##median_sort_step##suffix(                      \
+            prefix##median_state##suffix *S,                                    \
+            const size_t budget) {                                              \
                                                                                 \
-        size_t i, l, r, gap;                                                    \
-        type_t temp;                                                            \
+        const size_t MIN_SIZE = 1 << power;                                     \
                                                                                 \
-        /* Find the starting gap */                                             \
-        for (i = 1; i < 54 && gaps[i] < length; ++i);                           \
+        size_t r, spent = 0;                                                    \
                                                                                 \
-        /* Shell Sort */                                                        \
-        do {gap = gaps[--i];                                                    \
-            for (r = gap; r < length; ++r) {                                    \
-                temp = A[r];                                                    \
-                l    = r;                                                       \
-                while (less_than(temp, A[l-gap])) {                             \
-                    A[l] = A[l-gap];                                            \
-                    l   -= gap;                                                 \
-                    if (l < gap) { break; }                                     \
+        /* MEDIAN SORT (depth-first, until the next interval exceeds budget) */ \
+        while (S->l < S->length) {                                              \
+            r = (S->l + S->w) > S->length ? S->length : (S->l + S->w);          \
+            if (spent && spent + (r - S->l) > budget) { break; }                \
+            spent += r - S->l;                                                  \
+                                                                                \
+            if (S->w > MIN_SIZE) {                                              \
+                                                                                \
+                /* QUICK SELECT rank in the interval [l, r) and go left */      \
+                if (S->l + S->w/2 < S->length) {                                \
+                    prefix##select_interval##suffix(S->A, S->length, S->l, r,   \
+                                                    S->l + S->w/2);             \
                 }                                                               \
-                A[l] = temp;                                                    \
+                S->w >>= 1;                                                     \
+            } else {                                                            \
+                                                                                \
+                /* LEAF SORT the block [l, r) and go to the next subtree */     \
+                if (MIN_SIZE > 1) {                                             \
+                    prefix##sort_interval##suffix(S->A, S->length, S->l, r);    \
+                }                                                               \
+                while (S->w < S->W && (S->l & S->w)) {                          \
+                    S->l -= S->w;                                               \
+                    S->w <<= 1;                                                 \
+                }                                                               \
+                S->l = S->w < S->W ? S->l + S->w : S->length;                   \
             }                                                                   \
-        } while (gap > 1);                                                      \
+        }                                                                       \
+        return spent;                                                           \
+    }                                                                           \
+                                                                                \
+    static inline int prefix##median_sort_done##suffix(                         \
+            const prefix##median_state##suffix *S) {                            \
+        return S->l >= S->length;                                               \
+    }                                                                           \
+                                                                                \
+    static inline size_t prefix##median_sort_ready##suffix(                     \
+            const prefix##median_state##suffix *S) {                            \
+        return S->l < S->length ? S->l : S->length;                             \
+    }                                                                           \
+                                                                                \
+    static inline int prefix##median_sort_is_final##suffix(                     \
+            const prefix##median_state##suffix *S,                              \
+            const size_t i) {                                                   \
+                                                                                \
+        const size_t MIN_SIZE = 1 << power;                                     \
+                                                                                \
+        size_t w, l;                                                            \
+                                                                                \
+        /* A[i] is final if it is in the sorted prefix... */                    \
+        if (i < S->l || S->l >= S->length) { return 1; }                        \
+                                                                                \
+        /* ...or the rank of an interval that was already selected, while   */  \
+        /* its left half is being sorted (the right half starts at A[i], so */  \
+        /* its quick_selects can move A[i] around until it is done)         */  \
+        w = (i & (~i + 1)) << 1;                                                \
+        l = i - w/2;                                                            \
+        return i && w > MIN_SIZE && w <= S->W &&                                \
+               l <= S->l && S->l < i && w > S->w;                               \
+    }                                                                           \
+                                                                                \
+    static inline void prefix##median_nth_element##suffix(type_t *A,            \
+                                                          const size_t length,  \
+                                                          const size_t k) {     \
+        if (k < length) { prefix##quick_select##suffix(A, length, k); }         \
     }                                                                           \
                                                                                 \
 
+/* Requires IMPORT_MEDIAN_SORT with the same type_t, prefix and suffix. */
+#define IMPORT_PARALLEL_MEDIAN_SORT(type_t, less_than, power, prefix, suffix)   \
+                                                                                \
+    typedef struct {                                                            \
+        type_t            *A;                                                   \
+        size_t             length;                                              \
+        size_t             nthreads;    /* Threads that started (0 = none)   */ \
+        size_t            *lo;          /* First position of each chunk      */ \
+        size_t            *split;       /* Partition point of each chunk     */ \
+        type_t             pivot;                                               \
+        pthread_barrier_t  barrier;                                             \
+        pthread_mutex_t    lock;        /* Held while the threads start      */ \
+    } prefix##median_shared##suffix;                                            \
+                                                                                \
+    typedef struct {                                                            \
+        prefix##median_shared##suffix *shared;                                  \
+        size_t                         id;                                      \
+    } prefix##median_task##suffix;                                              \
+                                                                                \
+    static type_t prefix##parallel_pivot##suffix(const type_t *A,               \
+                                                 const size_t length,           \
+                                                 const size_t rank) {           \
+                                                                                \
+        /* The element of a sorted sample that has the same relative rank */    \
+        type_t sample[31], t;                                                   \
+        size_t l, r;                                                            \
+                                                                                \
+        for (r = 0; r < 31; ++r) {                                              \
+            t = A[(r * (length-1)) / 30];                                       \
+            for (l=r; l && less_than(t, sample[l-1]); --l) {                    \
+                sample[l] = sample[l-1];                                        \
+            }                                                                   \
+            sample[l] = t;                                                      \
+        }                                                                       \
+        return sample[(rank * 31) / length];                                    \
+    }                                                                           \
+                                                                                \
+    static size_t prefix##parallel_partition##suffix(type_t *A,                 \
+                                                     const size_t length,       \
+                                                     const type_t pivot,        \
+                                                     const int strict) {        \
+                                                                                \
+        /* Moves the elements < pivot (or <= pivot if !strict) to the front */  \
+        size_t l = 0, r = length;                                               \
+        type_t t;                                                               \
+                                                                                \
+        for (;;) {                                                              \
+            if (strict) {                                                       \
+                while (l < r &&  less_than(A[l],   pivot)) { ++l; }             \
+                while (l < r && !less_than(A[r-1], pivot)) { --r; }             \
+            } else {                                                            \
+                while (l < r && !less_than(pivot, A[l]))   { ++l; }             \
+                while (l < r &&  less_than(pivot, A[r-1])) { --r; }             \
+            }                                                                   \
+            if (l >= r) { return l; }                                           \
+            --r; t = A[l]; A[l] = A[r]; A[r] = t; ++l; COUNT_SWAPS(1);          \
+        }                                                                       \
+    }                                                                           \
+                                                                                \
+    static size_t prefix##parallel_seek##suffix(const size_t *lo,               \
+                                                const size_t *split,            \
+                                                const size_t  m,                \
+                                                const int     large,            \
+                                                size_t       *chunk,            \
+                                                size_t       *end,              \
+                                                size_t        k) {              \
+                                                                                \
+        /* Position of the k-th misplaced element from the current chunk on */  \
+        size_t s, e;                                                            \
+                                                                                \
+        for (;; ++*chunk) {                                                     \
+            if (large) { s = split[*chunk];                                     \
+                         e = lo[*chunk+1] < m ? lo[*chunk+1] : m; }             \
+            else       { s = lo[*chunk] > m ? lo[*chunk] : m;                   \
+                         e = split[*chunk];                     }               \
+            if (s < e) {                                                        \
+                if (k < e-s) { *end = e; return s+k; }                          \
+                k -= e-s;                                                       \
+            }                                                                   \
+        }                                                                       \
+    }                                                                           \
+                                                                                \
+    /* Selects rank in A[0, length) with all the threads at once. In every  */  \
+    /* round thread 0 samples a pivot, each thread partitions its own chunk */  \
+    /* around it, and then the misplaced elements (large ones before the    */  \
+    /* split m, small ones after it) are swapped in pairs, in equal shares. */  \
+    /* If the pivot was the minimum, a round with <= (strict = 0) follows.  */  \
+    /* Below 2^14 elements per thread (or after 16 unbalanced rounds),      */  \
+    /* thread 0 finishes alone with quick_select.                           */  \
+    static void prefix##parallel_select##suffix(                                \
+                                       const prefix##median_task##suffix *task, \
+                                       type_t *A, const size_t length,          \
+                                       const size_t rank) {                     \
+                                                                                \
+        prefix##median_shared##suffix *shared = task->shared;                   \
+                                                                                \
+        const size_t id       = task->id;                                       \
+        const size_t nthreads = shared->nthreads;                               \
+                                                                                \
+        size_t c, m, k, x, y, xc, yc, xe, ye, first, last, size;                \
+        size_t left   = 0;                                                      \
+        size_t right  = length;                                                 \
+        size_t limit  = 16;                                                     \
+        int    strict = 1;                                                      \
+        type_t t;                                                               \
+                                                                                \
+        /* PARALLEL PARTITION (down to 2^14 elements per thread) */             \
+        while (limit && (size = right-left) > (nthreads << 14)) {               \
+                                                                                \
+            /* Thread 0 samples a new pivot unless the last one was the min */  \
+            if (id == 0 && strict) {                                            \
+                shared->pivot = prefix##parallel_pivot##suffix(A+left, size,    \
+                                                               rank-left);      \
+            }                                                                   \
+            if (id == 0) { shared->lo[nthreads] = right; }                      \
+            shared->lo[id] = left + (size * id) / nthreads;                     \
+            pthread_barrier_wait(&shared->barrier);                             \
+                                                                                \
+            /* Each thread partitions its own chunk */                          \
+            first = shared->lo[id];                                             \
+            last  = left + (size * (id+1)) / nthreads;                          \
+            shared->split[id] = first +                                         \
+                prefix##parallel_partition##suffix(A+first, last-first,         \
+                                                   shared->pivot, strict);      \
+            pthread_barrier_wait(&shared->barrier);                             \
+                                                                                \
+            /* Misplaced elements: large ones in [left, m), small in [m, r) */  \
+            for (m = left, c = 0; c < nthreads; ++c) {                          \
+                m += shared->split[c] - shared->lo[c];                          \
+            }                                                                   \
+            for (k = 0, c = 0; c < nthreads; ++c) {                             \
+                x  = shared->split[c];                                          \
+                xe = shared->lo[c+1] < m ? shared->lo[c+1] : m;                 \
+                k += x < xe ? xe-x : 0;                                         \
+            }                                                                   \
+                                                                                \
+            /* Each thread swaps its own share of misplaced pairs */            \
+            first = (k *  id   ) / nthreads;                                    \
+            last  = (k * (id+1)) / nthreads;                                    \
+            if (first < last) {                                                 \
+                xc = yc = 0;                                                    \
+                x  = prefix##parallel_seek##suffix(shared->lo, shared->split,   \
+                                                   m, 1, &xc, &xe, first);      \
+                y  = prefix##parallel_seek##suffix(shared->lo, shared->split,   \
+                                                   m, 0, &yc, &ye, first);      \
+                for (k = first; k < last; ++k, ++x, ++y) {                      \
+                    if (x == xe) {                                              \
+                        ++xc;                                                   \
+                        x = prefix##parallel_seek##suffix(shared->lo,           \
+                                                          shared->split,        \
+                                                          m, 1, &xc, &xe, 0);   \
+                    }                                                           \
+                    if (y == ye) {                                              \
+                        ++yc;                                                   \
+                        y = prefix##parallel_seek##suffix(shared->lo,           \
+                                                          shared->split,        \
+                                                          m, 0, &yc, &ye, 0);   \
+                    }                                                           \
+                    t = A[x]; A[x] = A[y]; A[y] = t;                            \
+                }                                                               \
+            }                                                                   \
+            pthread_barrier_wait(&shared->barrier);                             \
+                                                                                \
+            /* After 16 unbalanced rounds let quick_select take over */         \
+            if (m-left < size/8 || right-m < size/8) { --limit; }               \
+                                                                                \
+            /* Every thread reaches the same conclusion */                      \
+            if (!strict) {                                                      \
+                if (rank < m) { return; }                                       \
+                left = m; strict = 1;                                           \
+            }                                                                   \
+            else if (rank < m) { right = m; }                                   \
+            else if (left < m) { left  = m; }                                   \
+            else               { strict = 0; }                                  \
+        }                                                                       \
+                                                                                \
+        /* QUICK SELECT (the rest is done by thread 0 alone) */                 \
+        /* (A[left-1] <= A[left..right) so it can be used to keep rank > 0) */  \
+        if (id == 0 && left > 0) {                                              \
+            prefix##quick_select##suffix(A+left-1, right-left+1, rank-left+1);  \
+        }                                                                       \
+        if (id == 0 && left == 0) {                                             \
+            prefix##quick_select##suffix(A, right, rank);                       \
+        }                                                                       \
+    }                                                                           \
+                                                                                \
+    static void *prefix##median_worker##suffix(void *arg) {                     \
+                                                                                \
+        const prefix##median_task##suffix *task = arg;                          \
+        const size_t MIN_SIZE = 1 << power;                                     \
+                                                                                \
+        type_t      *A        = task->shared->A;                                \
+        const size_t length   = task->shared->length;                           \
+        const size_t id       = task->id;                                       \
+                                                                                \
+        size_t i, n, l, r, rank, step, first, last, nthreads;                   \
+                                                                                \
+        /* Wait until the calling thread knows how many threads started */      \
+        pthread_mutex_lock(&task->shared->lock);                                \
+        nthreads = task->shared->nthreads;                                      \
+        pthread_mutex_unlock(&task->shared->lock);                              \
+        if (id >= nthreads) { return NULL; }                                    \
+                                                                                \
+        /* MEDIAN SORT (each level is split in nthreads chunks of intervals) */ \
+        for (step   = 1; step <  length;   step <<= 1);                         \
+        for (step >>= 1; step >= MIN_SIZE; step >>= 1) {                        \
+            n = (length + step - 1) / (step << 1);                              \
+                                                                                \
+            /* Few (and large) intervals: all the threads work on each one */   \
+            if (n < nthreads) {                                                 \
+                for (rank = step; rank < length; rank += (step << 1)) {         \
+                    l = (rank-step);                                            \
+                    r = (rank+step) > length ? length : (rank+step);            \
+                                                                                \
+                    /* PARALLEL SELECT rank in the interval [l, r) */           \
+                    prefix##parallel_select##suffix(task, A+l, r-l, step);      \
+                }                                                               \
+            }                                                                   \
+                                                                                \
+            /* Many intervals: each thread works on its own chunk [first,   */  \
+            /* last) of them, which is passed as the whole array, so that   */  \
+            /* the flat interval test never reads the neighbour chunks      */  \
+            /* (which other threads are partitioning at the same time)      */  \
+            else {                                                              \
+                first = (step << 1) * ((n* id   )/nthreads);                    \
+                last  = (step << 1) * ((n*(id+1))/nthreads);                    \
+                last  = last > length ? length : last;                          \
+                for (i = (n*id)/nthreads; i < (n*(id+1))/nthreads; ++i) {       \
+                    rank = step + i * (step << 1);                              \
+                    l = (rank-step);                                            \
+                    r = (rank+step) > length ? length : (rank+step);            \
+                                                                                \
+                    /* QUICK SELECT rank in the interval [l, r) */              \
+                    prefix##select_interval##suffix(A+first, last-first,        \
+                                                    l-first, r-first,           \
+                                                    rank-first);                \
+                }                                                               \
+            }                                                                   \
+            pthread_barrier_wait(&task->shared->barrier);                       \
+        }                                                                       \
+                                                                                \
+        /* LEAF SORT (each thread sorts its own chunk of blocks) */             \
+        if (MIN_SIZE > 1) {                                                     \
+            n     = (length + MIN_SIZE - 1) / MIN_SIZE;                         \
+            first = MIN_SIZE * ((n* id   )/nthreads);                           \
+            last  = MIN_SIZE * ((n*(id+1))/nthreads);                           \
+            last  = last > length ? length : last;                              \
+            for (l = first; l < last; l += MIN_SIZE) {                          \
+                r = (l + MIN_SIZE) > last ? last : (l + MIN_SIZE);              \
+                prefix##sort_interval##suffix(A+first, last-first,              \
+                                              l-first, r-first);                \
+            }                                                                   \
+        }                                                                       \
+        return NULL;                                                            \
+    }                                                                           \
+                                                                                \
+    static void prefix##parallel_median_sort##suffix(type_t *A,                 \
+                                                     const size_t length,       \
+                                                     const size_t nthreads) {   \
+                                                                                \
+        prefix##median_shared##suffix  shared;                                  \
+        prefix##median_task##suffix   *tasks;                                   \
+        pthread_t                     *threads;                                 \
+        size_t                         i, started;                              \
+        int                            error;                                   \
+                                                                                \
+        /* Not worth the threads */                                             \
+        if (nthreads < 2 || length < 2) {                                       \
+            prefix##median_sort##suffix(A, length);                             \
+            return;                                                             \
+        }                                                                       \
+                                                                                \
+        threads      = (pthread_t *) malloc(nthreads * sizeof(pthread_t));      \
+        tasks        = (prefix##median_task##suffix *)                          \
+                       malloc(nthreads * sizeof(prefix##median_task##suffix));  \
+        shared.lo    = (size_t *) malloc((nthreads+1) * sizeof(size_t));        \
+        shared.split = (size_t *) malloc( nthreads    * sizeof(size_t));        \
+                                                                                \
+        shared.A        = A;                                                    \
+        shared.length   = length;                                               \
+        shared.nthreads = 0;                                                    \
+                                                                                \
+        /* The other threads wait on the lock until the barrier is sized    */  \
+        /* for the ones that could be created (if none, or the barrier      */  \
+        /* fails, they all quit and the array is sorted serially, as it is  */  \
+        /* when there is no memory for the threads)                         */  \
+        if (threads && tasks && shared.lo && shared.split &&                    \
+            pthread_mutex_init(&shared.lock, NULL) == 0) {                      \
+                                                                                \
+            /* The calling thread works as thread 0 */                          \
+            for (i = 0; i < nthreads; ++i) {                                    \
+                tasks[i].shared = &shared;                                      \
+                tasks[i].id     = i;                                            \
+            }                                                                   \
+                                                                                \
+            pthread_mutex_lock(&shared.lock);                                   \
+            for (started = 1; started < nthreads; ++started) {                  \
+                error = pthread_create(&threads[started], NULL,                 \
+                                       &prefix##median_worker##suffix,          \
+                                       &tasks[started]);                        \
+                if (error) { break; }                                           \
+            }                                                                   \
+            error = started < 2 ? -1 :                                          \
+                    pthread_barrier_init(&shared.barrier, NULL,                 \
+                                         (unsigned) started);                   \
+            shared.nthreads = error ? 0 : started;                              \
+            pthread_mutex_unlock(&shared.lock);                                 \
+                                                                                \
+            if (shared.nthreads) { prefix##median_worker##suffix(&tasks[0]); }  \
+            for (i = 1; i < started; ++i) { pthread_join(threads[i], NULL); }   \
+            if (shared.nthreads) { pthread_barrier_destroy(&shared.barrier); }  \
+            pthread_mutex_destroy(&shared.lock);                                \
+        }                                                                       \
+        if (!shared.nthreads) { prefix##median_sort##suffix(A, length); }       \
+                                                                                \
+        free(shared.split);                                                     \
+        free(shared.lo);                                                        \
+        free(threads);                                                          \
+        free(tasks);                                                            \
+    }                                                                           \
+                                                                                \
+
+/* IMPORT_MEDIAN_SORT_BATCH (that requires IMPORT_MEDIAN_SORT with the same  */
+/* type_t, prefix and suffix) creates median_sort_batch(arrays, lengths,     */
+/* count), which sorts count independent arrays, and median_sort_rows(A,     */
+/* rows, length, stride), which sorts the rows A[i*stride, i*stride+length)  */
+/* of a matrix. Consecutive arrays of the same length (up to BATCH_SIZE) are */
+/* sorted BATCH_LANES at a time: they are interleaved in a buffer and sorted */
+/* together by a bitonic network whose compare-exchanges work on a whole row */
+/* of lanes, so the compiler can turn them into SIMD min/max instructions.   */
+/* Longer arrays (and lone ones) go through median_sort. parallel_median_    */
+/* sort_batch and parallel_median_sort_rows give each of nthreads threads a  */
+/* contiguous range of arrays.                                               */
+
+#define BATCH_LANES 8
+#define BATCH_SIZE  512
+
+#define IMPORT_MEDIAN_SORT_BATCH(type_t, less_than, prefix, suffix)             \
+                                                                                \
+    /* Compare-exchanges the BATCH_LANES lanes of X and Y (which do not     */  \
+    /* overlap, so that the loop can be vectorized)                         */  \
+    static inline void prefix##lanes_exchange##suffix(type_t *restrict X,       \
+                                                      type_t *restrict Y) {     \
+        size_t q;                                                               \
+        type_t u, v;                                                            \
+        int    c;                                                               \
+                                                                                \
+        for (q = 0; q < BATCH_LANES; ++q) {                                     \
+            u = X[q]; v = Y[q]; c = less_than(v, u);                            \
+            X[q] = c ? v : u; Y[q] = c ? u : v;                                 \
+        }                                                                       \
+    }                                                                           \
+                                                                                \
+    static void prefix##lanes_network##suffix(type_t *T, const size_t length) { \
+                                                                                \
+        size_t i, j, k, n, p;                                                   \
+                                                                                \
+        /* BITONIC SORT (lane q of position i is T[i*BATCH_LANES+q]) */         \
+        for (p = 1; p < length; p <<= 1) {                                      \
+            for (j = 0; j + p < length; j += (p << 1)) {                        \
+                n = j + (p << 1) > length ? length - j - p : p;                 \
+                for (i = p - n; i < p; ++i) {                                   \
+                    prefix##lanes_exchange##suffix(T + (j+i)*BATCH_LANES,       \
+                                         T + (j+(p<<1)-1-i)*BATCH_LANES);       \
+                }                                                               \
+            }                                                                   \
+            for (k = p >> 1; k > 0; k >>= 1) {                                  \
+                for (j = 0; j + k < length; j += (k << 1)) {                    \
+                    n = j + (k << 1) > length ? length - j - k : k;             \
+                    for (i = 0; i < n; ++i) {                                   \
+                        prefix##lanes_exchange##suffix(T + (j+i)*BATCH_LANES,   \
+                                             T + (j+k+i)*BATCH_LANES);          \
+                    }                                                           \
+                }                                                               \
+            }                                                                   \
+        }                                                                       \
+    }                                                                           \
+                                                                                \
+    /* Sorts the n arrays of rows (all of the given length) with T          */  \
+    static void prefix##lanes_sort##suffix(type_t **rows, const size_t n,       \
+                                           const size_t length, type_t **T) {   \
+        size_t i, q;                                                            \
+                                                                                \
+        if (n == 1) { prefix##median_sort##suffix(rows[0], length); return; }   \
+        if (*T == NULL) {                                                       \
+            *T = (type_t *) malloc(BATCH_LANES * BATCH_SIZE * sizeof(type_t));  \
+        }                                                                       \
+                                                                                \
+        /* Without memory for the lanes, the arrays are sorted one by one */    \
+        if (*T == NULL) {                                                       \
+            for (q = 0; q < n; ++q) {                                           \
+                prefix##median_sort##suffix(rows[q], length);                   \
+            }                                                                   \
+            return;                                                             \
+        }                                                                       \
+                                                                                \
+        /* Missing lanes repeat the first array (and write it back as is) */    \
+        for (q = 0; q < BATCH_LANES; ++q) {                                     \
+            for (i = 0; i < length; ++i) {                                      \
+                (*T)[i*BATCH_LANES+q] = rows[q < n ? q : 0][i];                 \
+            }                                                                   \
+        }                                                                       \
+        prefix##lanes_network##suffix(*T, length);                              \
+        for (q = 0; q < n; ++q) {                                               \
+            for (i = 0; i < length; ++i) {                                      \
+                rows[q][i] = (*T)[i*BATCH_LANES+q];                             \
+            }                                                                   \
+        }                                                                       \
+    }                                                                           \
+                                                                                \
+    static void prefix##median_sort_batch##suffix(type_t **arrays,              \
+                                                  const size_t *lengths,        \
+                                                  const size_t count) {         \
+                                                                                \
+        type_t *rows[BATCH_LANES], *T = NULL;                                   \
+        size_t  i, n = 0, length = 0;                                           \
+                                                                                \
+        for (i = 0; i < count; ++i) {                                           \
+            if (lengths[i] < 2 || lengths[i] > BATCH_SIZE) {                    \
+                prefix##median_sort##suffix(arrays[i], lengths[i]);             \
+                continue;                                                       \
+            }                                                                   \
+            if (n == BATCH_LANES || (n > 0 && lengths[i] != length)) {          \
+                prefix##lanes_sort##suffix(rows, n, length, &T);                \
+                n = 0;                                                          \
+            }                                                                   \
+            length    = lengths[i];                                             \
+            rows[n++] = arrays[i];                                              \
+        }                                                                       \
+        if (n > 0) { prefix##lanes_sort##suffix(rows, n, length, &T); }         \
+        free(T);                                                                \
+    }                                                                           \
+                                                                                \
+    static void prefix##median_sort_rows##suffix(type_t *A, const size_t rows,  \
+                                                 const size_t length,           \
+                                                 const size_t stride) {         \
+                                                                                \
+        type_t *group[BATCH_LANES], *T = NULL;                                  \
+        size_t  i, n;                                                           \
+                                                                                \
+        for (i = 0; i < rows; i += n) {                                         \
+            if (length < 2 || length > BATCH_SIZE) {                            \
+                prefix##median_sort##suffix(A + i*stride, length);              \
+                n = 1;                                                          \
+                continue;                                                       \
+            }                                                                   \
+            for (n = 0; n < BATCH_LANES && i+n < rows; ++n) {                   \
+                group[n] = A + (i+n)*stride;                                    \
+            }                                                                   \
+            prefix##lanes_sort##suffix(group, n, length, &T);                   \
+        }                                                                       \
+        free(T);                                                                \
+    }                                                                           \
+                                                                                \
+    typedef struct {                                                            \
+        type_t      **arrays;       /* Batch of arrays (or NULL for rows)  */   \
+        const size_t *lengths;                                                  \
+        type_t       *A;            /* Matrix of rows                      */   \
+        size_t        first, last;  /* Range of arrays of this thread      */   \
+        size_t        length, stride;                                           \
+    } prefix##batch_task##suffix;                                               \
+                                                                                \
+    static void *prefix##batch_worker##suffix(void *arg) {                      \
+        const prefix##batch_task##suffix *task = arg;                           \
+        if (task->arrays) {                                                     \
+            prefix##median_sort_batch##suffix(task->arrays + task->first,       \
+                                              task->lengths + task->first,      \
+                                              task->last - task->first);        \
+        } else {                                                                \
+            prefix##median_sort_rows##suffix(task->A + task->first*task->stride,\
+                                             task->last - task->first,          \
+                                             task->length, task->stride);       \
+        }                                                                       \
+        return NULL;                                                            \
+    }                                                                           \
+                                                                                \
+    static void prefix##parallel_batch##suffix(prefix##batch_task##suffix job,  \
+                                               const size_t count,              \
+                                               size_t nthreads) {               \
+                                                                                \
+        prefix##batch_task##suffix *tasks;                                      \
+        pthread_t                  *threads;                                    \
+        size_t                      i, started;                                 \
+                                                                                \
+        /* At least BATCH_LANES arrays per thread */                            \
+        if (nthreads > count / BATCH_LANES) { nthreads = count / BATCH_LANES; } \
+        threads = nthreads < 2 ? NULL :                                         \
+                  (pthread_t *) malloc(nthreads * sizeof(pthread_t));           \
+        tasks   = threads == NULL ? NULL : (prefix##batch_task##suffix *)       \
+                  malloc(nthreads * sizeof(prefix##batch_task##suffix));        \
+                                                                                \
+        /* Not worth the threads (or no memory for them) */                     \
+        if (tasks == NULL) {                                                    \
+            free(threads);                                                      \
+            job.first = 0;                                                      \
+            job.last  = count;                                                  \
+            prefix##batch_worker##suffix(&job);                                 \
+            return;                                                             \
+        }                                                                       \
+                                                                                \
+        /* The calling thread works as thread 0 */                              \
+        for (i = 0; i < nthreads; ++i) {                                        \
+            tasks[i]       = job;                                               \
+            tasks[i].first = (count *  i   ) / nthreads;                        \
+            tasks[i].last  = (count * (i+1)) / nthreads;                        \
+        }                                                                       \
+        for (started = 1; started < nthreads; ++started) {                      \
+            if (pthread_create(&threads[started], NULL,                         \
+                               &prefix##batch_worker##suffix,                   \
+                               &tasks[started]) != 0) { break; }                \
+        }                                                                       \
+                                                                                \
+        /* And also of the threads that could not be created */                 \
+        prefix##batch_worker##suffix(&tasks[0]);                                \
+        for (i = started; i < nthreads; ++i) {                                  \
+            prefix##batch_worker##suffix(&tasks[i]);                            \
+        }                                                                       \
+        for (i = 1; i < started; ++i) { pthread_join(threads[i], NULL); }       \
+                                                                                \
+        free(threads);                                                          \
+        free(tasks);                                                            \
+    }                                                                           \
+                                                                                \
+    static inline void prefix##parallel_median_sort_batch##suffix(              \
+            type_t **arrays, const size_t *lengths, const size_t count,         \
+            const size_t nthreads) {                                            \
+        prefix##batch_task##suffix job;                                         \
+        memset(&job, 0, sizeof(job));                                           \
+        job.arrays  = arrays;                                                   \
+        job.lengths = lengths;                                                  \
+        prefix##parallel_batch##suffix(job, count, nthreads);                   \
+    }                                                                           \
+                                                                                \
+    static inline void prefix##parallel_median_sort_rows##suffix(               \
+            type_t *A, const size_t rows, const size_t length,                  \
+            const size_t stride, const size_t nthreads) {                       \
+        prefix##batch_task##suffix job;                                         \
+        memset(&job, 0, sizeof(job));                                           \
+        job.A      = A;                                                         \
+        job.length = length;                                                    \
+        job.stride = stride;                                                    \
+        prefix##parallel_batch##suffix(job, rows, nthreads);                    \
+    }                                                                           \
+                                                                                \
+
+/* Rearranges the length records (of the given size) of base so that the new */
+/* i-th record is the old index[i]-th one, following each cycle of the index */
+/* through a scratch buffer of SCRATCH_SIZE bytes (in pieces, if needed).    */
+/* Visited positions are marked with the top bit of index, which is cleared  */
+/* at the end, so the same index can be applied to several arrays. Since the */
+/* cycles jump all over base, the next record of the cycle is prefetched.    */
+
+#define SCRATCH_SIZE 256
+#define VISITED      (~(SIZE_MAX >> 1))
+
+#if defined(__GNUC__)
+#define PREFETCH(p) __builtin_prefetch(p)
+#else
+#define PREFETCH(p) ((void) (p))
+#endif
+
+static void permute(void *base, const size_t length, const size_t size,
+                    size_t *index) {
+
+    unsigned char  scratch[SCRATCH_SIZE];
+    unsigned char *B = (unsigned char *) base;
+    size_t i, j, k, o, m;
+
+    if (size == 0) { return; }
+    for (i = 0; i < length; ++i) {
+        if (index[i] == i || (index[i] & VISITED)) { continue; }
+        for (o = 0; o < size; o += m) {
+            m = (size-o < SCRATCH_SIZE) ? size-o : SCRATCH_SIZE;
+            memcpy(scratch, B + i*size + o, m);
+            for (j = i; (k = index[j] & ~VISITED) != i; j = k) {
+                PREFETCH(B + (index[k] & ~VISITED)*size + o);
+                PREFETCH(index + (index[k] & ~VISITED));
+                memcpy(B + j*size + o, B + k*size + o, m);
+                if (o+m == size) { index[j] |= VISITED; }
+            }
+            memcpy(B + j*size + o, scratch, m);
+        }
+        index[j] |= VISITED;
+    }
+    for (i = 0; i < length; ++i) { index[i] &= ~VISITED; }
+}
+
+/* IMPORT_MEDIAN_ARGSORT creates median_argsort(A, length, index), which     */
+/* leaves A untouched and fills index with the permutation that sorts it     */
+/* (A[index[0]] <= A[index[1]] <= ...) by sorting (key, index) pairs, with   */
+/* 32-bit indices whenever length fits (8 byte pairs for int keys), and      */
+/* returns 0, or -1 (with index untouched) if the pairs cannot be allocated. */
+/* IMPORT_MEDIAN_SORT_KV (that requires IMPORT_MEDIAN_ARGSORT with the same  */
+/* type_t, prefix and suffix) creates median_sort_kv(K, length, payloads,    */
+/* sizes, count), which sorts the keys K and moves the records of the count  */
+/* parallel arrays payloads[c] (of sizes[c] bytes each) along with them, and */
+/* returns 0, or -1 (with nothing moved) if it runs out of memory.           */
+
+#define IMPORT_MEDIAN_ARGSORT(type_t, less_than, power, prefix, suffix)         \
+                                                                                \
+    typedef struct {                                                            \
+        type_t key;                                                             \
+        size_t index;                                                           \
+    } prefix##median_pair##suffix;                                              \
+                                                                                \
+    typedef struct {                                                            \
+        type_t   key;                                                           \
+        uint32_t index;                                                         \
+    } prefix##median_pair32##suffix;                                            \
+                                                                                \
+    static inline int prefix##pair_less_than##suffix(                           \
+            const prefix##median_pair##suffix x,                                \
+            const prefix##median_pair##suffix y) {                              \
+        return less_than(x.key, y.key);                                         \
+    }                                                                           \
+                                                                                \
+    static inline int prefix##pair32_less_than##suffix(                         \
+            const prefix##median_pair32##suffix x,                              \
+            const prefix##median_pair32##suffix y) {                            \
+        return less_than(x.key, y.key);                                         \
+    }                                                                           \
+                                                                                \
+    IMPORT_BLOCK_PARTITION(prefix##median_pair##suffix,                         \
+                           prefix##pair_less_than##suffix,                      \
+                           prefix##pair_, suffix)                               \
+    IMPORT_MEDIAN_SORT(prefix##median_pair##suffix,                             \
+                       prefix##pair_less_than##suffix, power,                   \
+                       prefix##pair_block_partition##suffix,                    \
+                       prefix##pair_, suffix)                                   \
+    IMPORT_BLOCK_PARTITION(prefix##median_pair32##suffix,                       \
+                           prefix##pair32_less_than##suffix,                    \
+                           prefix##pair32_, suffix)                             \
+    IMPORT_MEDIAN_SORT(prefix##median_pair32##suffix,                           \
+                       prefix##pair32_less_than##suffix, power,                 \
+                       prefix##pair32_block_partition##suffix,                  \
+                       prefix##pair32_, suffix)                                 \
+                                                                                \
+    /* Fills index (and K with the sorted keys, unless it is NULL) */           \
+    static int prefix##median_positions##suffix(const type_t *A,                \
+                                                const size_t length,            \
+                                                type_t *K, size_t *index) {     \
+                                                                                \
+        prefix##median_pair##suffix   *P = NULL;                                \
+        prefix##median_pair32##suffix *Q = NULL;                                \
+        size_t i;                                                               \
+                                                                                \
+        if (length <= UINT32_MAX) {                                             \
+                                                                                \
+            /* Compact pairs: twice as many int keys in every cache line */     \
+            if ((Q = malloc(length * sizeof(*Q))) == NULL && length > 0) {      \
+                return -1;                                                      \
+            }                                                                   \
+            for (i = 0; i < length; ++i) {                                      \
+                Q[i].key = A[i]; Q[i].index = (uint32_t) i;                     \
+            }                                                                   \
+            prefix##pair32_median_sort##suffix(Q, length);                      \
+            for (i = 0; i < length; ++i) { index[i] = Q[i].index; }             \
+            if (K != NULL) {                                                    \
+                for (i = 0; i < length; ++i) { K[i] = Q[i].key; }               \
+            }                                                                   \
+            free(Q);                                                            \
+        } else {                                                                \
+                                                                                \
+            if ((P = malloc(length * sizeof(*P))) == NULL) { return -1; }       \
+            for (i = 0; i < length; ++i) { P[i].key = A[i]; P[i].index = i; }   \
+            prefix##pair_median_sort##suffix(P, length);                        \
+            for (i = 0; i < length; ++i) { index[i] = P[i].index; }             \
+            if (K != NULL) {                                                    \
+                for (i = 0; i < length; ++i) { K[i] = P[i].key; }               \
+            }                                                                   \
+            free(P);                                                            \
+        }                                                                       \
+        return 0;                                                               \
+    }                                                                           \
+                                                                                \
+    static int prefix##median_argsort##suffix(const type_t *A,                  \
+                                              const size_t length,              \
+                                              size_t *index) {                  \
+        return prefix##median_positions##suffix(A, length, NULL, index);        \
+    }                                                                           \
+                                                                                \
+
+#define IMPORT_MEDIAN_SORT_KV(type_t, prefix, suffix)                           \
+                                                                                \
+    static inline int prefix##median_sort_kv##suffix(type_t *K,                 \
+                                                     const size_t length,       \
+                                                     void *const *payloads,     \
+                                                     const size_t *sizes,       \
+                                                     const size_t count) {      \
+                                                                                \
+        size_t *index = malloc(length * sizeof(size_t));                        \
+        size_t c;                                                               \
+                                                                                \
+        /* Sort the keys along with their positions */                          \
+        if (index == NULL && length > 0) { return -1; }                         \
+        if (prefix##median_positions##suffix(K, length, K, index) != 0) {       \
+            free(index);                                                        \
+            return -1;                                                          \
+        }                                                                       \
+                                                                                \
+        /* Apply the same permutation to each payload */                        \
+        for (c = 0; c < count; ++c) {                                           \
+            permute(payloads[c], length, sizes[c], index);                      \
+        }                                                                       \
+        free(index);                                                            \
+        return 0;                                                               \
+    }                                                                           \
+                                                                                \
+
+/* IMPORT_MEDIAN_SORT_FILE (that requires IMPORT_MEDIAN_ARGSORT with the     */
+/* same type_t, prefix and suffix) creates median_sort_file(path, size,      */
+/* offset), which sorts in place a binary file of records of size bytes by   */
+/* the type_t key that each of them holds at the given offset, and returns 0 */
+/* on success and -1 otherwise. The file is memory mapped: the levels whose  */
+/* intervals do not fit in FILE_MEMORY bytes run quick_select right on the   */
+/* mapping (asking the kernel to read ahead of both ends of the partition),  */
+/* and then each block of the next level is read into memory once, sorted    */
+/* by key there and written back in order. median_sort_file_budget(path,     */
+/* size, offset, memory) does the same with a memory budget of its own.      */
+
+#ifndef FILE_MEMORY
+#define FILE_MEMORY ((size_t) 1 << 30)
+#endif
+
+#define FILE_WINDOW (1 << 22)   /* Bytes read ahead of each partition scan  */
+
+static inline void swap_records(unsigned char *x, unsigned char *y,
+                                size_t size) {
+
+    unsigned char scratch[SCRATCH_SIZE];
+    size_t m;
+
+    for (; size > 0; x += m, y += m, size -= m) {
+        m = size < SCRATCH_SIZE ? size : SCRATCH_SIZE;
+        memcpy(scratch, x, m); memcpy(x, y, m); memcpy(y, scratch, m);
+    }
+}
+
+static inline void advise_records(unsigned char *map, size_t from,
+                                  const size_t to) {
+
+    const long page = sysconf(_SC_PAGESIZE);
+
+    from -= from % (page > 0 ? (size_t) page : 4096);
+    if (from < to) {
+        (void) posix_madvise(map + from, to - from, POSIX_MADV_WILLNEED);
+    }
+}
+
+#define IMPORT_MEDIAN_SORT_FILE(type_t, less_than, prefix, suffix)              \
+                                                                                \
+    static inline type_t prefix##file_key##suffix(const unsigned char *B,       \
+                                                  const size_t i,               \
+                                                  const size_t size,            \
+                                                  const size_t offset) {        \
+        type_t key;                                                             \
+        memcpy(&key, B + i*size + offset, sizeof(type_t));                      \
+        return key;                                                             \
+    }                                                                           \
+                                                                                \
+    static void prefix##file_partition##suffix(unsigned char *B,                \
+                                               const size_t size,               \
+                                               const size_t offset,             \
+                                               const size_t left,               \
+                                               const size_t right,              \
+                                               const size_t pivot,              \
+                                               size_t *lo, size_t *hi) {        \
+                                                                                \
+        const size_t window = FILE_WINDOW / size + 1;                           \
+        const type_t p = prefix##file_key##suffix(B, pivot, size, offset);      \
+                                                                                \
+        size_t l = left, h = right, ahead_l = left, ahead_h = right;            \
+                                                                                \
+        /* HOARE PARTITION (of the records [left, right) of the mapping) */     \
+        do {if (l >= ahead_l) {                                                 \
+                ahead_l = h - l > window ? l + window : h;                      \
+                advise_records(B, l*size, ahead_l*size);                        \
+            }                                                                   \
+            if (h <= ahead_h) {                                                 \
+                ahead_h = h - l > window ? h - window : l;                      \
+                advise_records(B, ahead_h*size, h*size);                        \
+            }                                                                   \
+            while (less_than(prefix##file_key##suffix(B, l, size, offset),      \
+                             p)) { ++l; }                                       \
+            while (less_than(p, prefix##file_key##suffix(B, h-1, size,          \
+                                                         offset))) { --h; }     \
+            if (l < h) { --h; swap_records(B+l*size, B+h*size, size); ++l; }    \
+        } while (l < h);                                                        \
+                                                                                \
+        *lo = h;                                                                \
+        *hi = l;                                                                \
+    }                                                                           \
+                                                                                \
+    static void prefix##file_select##suffix(unsigned char *B,                   \
+                                            const size_t size,                  \
+                                            const size_t offset,                \
+                                            size_t left, size_t right,          \
+                                            const size_t rank) {                \
+                                                                                \
+        uint64_t seed  = (uint64_t) (right - left) | 1;                         \
+        size_t   limit = 16;                                                    \
+        size_t   pivot, lo, hi, n;                                              \
+                                                                                \
+        while (right-left > 1) {                                                \
+            n = right-left;                                                     \
+                                                                                \
+            /* After 16 unbalanced rounds use random pivots (xorshift) */       \
+            if (limit) { pivot = rank; }                                        \
+            else {                                                              \
+                seed ^= seed << 13; seed ^= seed >> 7; seed ^= seed << 17;      \
+                pivot = left + (size_t) (seed % n);                             \
+            }                                                                   \
+            prefix##file_partition##suffix(B, size, offset, left, right,        \
+                                           pivot, &lo, &hi);                    \
+            if (limit && (lo-left < n/8 || right-hi < n/8)) { --limit; }        \
+                                                                                \
+            if      (rank <  lo) { right = lo; }                                \
+            else if (rank >= hi) { left  = hi; }                                \
+            else                 { return;     }                                \
+        }                                                                       \
+    }                                                                           \
+                                                                                \
+    static int prefix##median_sort_file_budget##suffix(const char *path,        \
+                                                       const size_t size,       \
+                                                       const size_t offset,     \
+                                                       const size_t memory) {   \
+                                                                                \
+        prefix##median_pair##suffix *P;                                         \
+        unsigned char *map, *R;                                                 \
+        struct stat    info;                                                    \
+        size_t length, block, top, step, rank, l, r, i;                         \
+        int    fd, ok;                                                          \
+                                                                                \
+        if (size == 0 || offset + sizeof(type_t) > size) { return -1; }         \
+        if ((fd = open(path, O_RDWR)) < 0)               { return -1; }         \
+        if (fstat(fd, &info) != 0 || info.st_size < 0 ||                        \
+            (uintmax_t) info.st_size > SIZE_MAX ||                              \
+            (size_t) info.st_size % size != 0) { close(fd); return -1; }        \
+        length = (size_t) info.st_size / size;                                  \
+        if (length < 2) { close(fd); return 0; }                                \
+                                                                                \
+        /* The largest block of 2^k records (and their pairs) in memory */      \
+        for (block = 1; block < length &&                                       \
+             (block << 1) * (size + sizeof(*P)) <= memory; block <<= 1);        \
+                                                                                \
+        /* Allocated first, so that a failure leaves the file untouched */      \
+        R = (unsigned char *) malloc(block * size);                             \
+        P = malloc(block * sizeof(*P));                                         \
+        map = (R == NULL || P == NULL) ? MAP_FAILED :                           \
+              mmap(NULL, length*size, PROT_READ | PROT_WRITE, MAP_SHARED,       \
+                   fd, 0);                                                      \
+        close(fd);                                                              \
+        if (map == MAP_FAILED) { free(R); free(P); return -1; }                 \
+                                                                                \
+        /* MEDIAN SORT (on the mapping, the levels wider than a block) */       \
+        for (top = 1; top < length; top <<= 1);                                 \
+        for (step = top >> 1; step >= block; step >>= 1) {                      \
+            for (rank = step; rank < length; rank += (step << 1)) {             \
+                l = rank-step;                                                  \
+                r = (rank+step) > length ? length : (rank+step);                \
+                if (l > 0 && r < length &&                                      \
+                    !less_than(prefix##file_key##suffix(map, l-1, size, offset),\
+                               prefix##file_key##suffix(map, r, size, offset))) \
+                { continue; }                                                   \
+                prefix##file_select##suffix(map, size, offset, l, r, rank);     \
+            }                                                                   \
+        }                                                                       \
+                                                                                \
+        /* BLOCK SORT (in memory, while the kernel reads the next block) */     \
+        for (l = 0; l < length; l = r) {                                        \
+            r = (l + block) > length ? length : (l + block);                    \
+            if (r < length) {                                                   \
+                advise_records(map, r*size,                                     \
+                               ((r + block) > length ? length : (r + block)) *  \
+                               size);                                           \
+            }                                                                   \
+            if (l > 0 && r < length &&                                          \
+                !less_than(prefix##file_key##suffix(map, l-1, size, offset),    \
+                           prefix##file_key##suffix(map, r, size, offset)))     \
+            { continue; }                                                       \
+            memcpy(R, map + l*size, (r-l) * size);                              \
+            for (i = 0; i < r-l; ++i) {                                         \
+                P[i].key   = prefix##file_key##suffix(R, i, size, offset);      \
+                P[i].index = i;                                                 \
+            }                                                                   \
+            prefix##pair_median_sort##suffix(P, r-l);                           \
+            for (i = 0; i < r-l; ++i) {                                         \
+                memcpy(map + (l+i)*size, R + P[i].index*size, size);            \
+            }                                                                   \
+        }                                                                       \
+        free(R);                                                                \
+        free(P);                                                                \
+                                                                                \
+        ok = msync(map, length*size, MS_SYNC) == 0;                             \
+        ok = munmap(map, length*size) == 0 && ok;                               \
+        return ok ? 0 : -1;                                                     \
+    }                                                                           \
+                                                                                \
+    static inline int prefix##median_sort_file##suffix(const char *path,        \
+                                                       const size_t size,       \
+                                                       const size_t offset) {   \
+        return prefix##median_sort_file_budget##suffix(path, size, offset,      \
+                                                       FILE_MEMORY);            \
+    }                                                                           \
+                                                                                \
+
+/* IMPORT_MEDIAN_SORT_AUTO instantiates median_sort with hoare_partition and */
+/* block_partition for every power in [4, 8] and creates median_sort_auto,   */
+/* which picks one of them by the size class (floor(log2(length))) of the    */
+/* input, using a table that starts with block_partition and power 7 for all */
+/* the classes. median_sort_calibrate(A, length) times every configuration   */
+/* on copies of the prefixes of A of length 2^k (so A should be a sample of  */
+/* the data to sort) and keeps the fastest one for each class (it leaves the */
+/* table untouched if there is no memory for the copies). The table can be   */
+/* written with median_tuning_save(path) and read back on the next run with  */
+/* median_tuning_load(path), that return 0 on success and -1 otherwise       */
+/* (leaving the table untouched if the file is not valid for this type_t).   */
+/* The entries of the table are single bytes that are read and written with  */
+/* atomic builtins, so median_sort_auto can run while another thread is      */
+/* calibrating or loading the table (each size class sees either its old or  */
+/* its new configuration). Without GCC builtins, calibrate before sorting.   */
+
+#define TUNING_CLASSES 64
+#define TUNING_CONFIGS 10
+#define TUNING_DEFAULT  8   /* block_partition with power 7              */
+#define TUNING_MINIMUM  8   /* Shortest sample (2^8) that is timed       */
+#define TUNING_BUDGET  18   /* Each configuration sorts 2^18 elements    */
+
+#if defined(__GNUC__)
+#define TUNING_GET(entry)    __atomic_load_n(&(entry), __ATOMIC_RELAXED)
+#define TUNING_SET(entry, c) __atomic_store_n(&(entry), (c), __ATOMIC_RELAXED)
+#else
+#define TUNING_GET(entry)    (entry)
+#define TUNING_SET(entry, c) ((entry) = (c))
+#endif
+
+static inline double wall_clock(void) {
+
+    /* Elapsed time (in seconds) that also accounts for threads */
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return (double) t.tv_sec + 1e-9 * (double) t.tv_nsec;
+}
+
+#define IMPORT_MEDIAN_SORT_AUTO(type_t, less_than, prefix, suffix)              \
+                                                                                \
+    IMPORT_HOARE_PARTITION(type_t, less_than, prefix##auto_, suffix)            \
+    IMPORT_BLOCK_PARTITION(type_t, less_than, prefix##auto_, suffix)            \
+                                                                                \
+    IMPORT_MEDIAN_SORT(type_t, less_than, 4,                                    \
+                       prefix##auto_hoare_partition##suffix,                    \
+                       prefix##auto_hoare_, suffix##_4)                         \
+    IMPORT_MEDIAN_SORT(type_t, less_than, 5,                                    \
+                       prefix##auto_hoare_partition##suffix,                    \
+                       prefix##auto_hoare_, suffix##_5)                         \
+    IMPORT_MEDIAN_SORT(type_t, less_than, 6,                                    \
+                       prefix##auto_hoare_partition##suffix,                    \
+                       prefix##auto_hoare_, suffix##_6)                         \
+    IMPORT_MEDIAN_SORT(type_t, less_than, 7,                                    \
+                       prefix##auto_hoare_partition##suffix,                    \
+                       prefix##auto_hoare_, suffix##_7)                         \
+    IMPORT_MEDIAN_SORT(type_t, less_than, 8,                                    \
+                       prefix##auto_hoare_partition##suffix,                    \
+                       prefix##auto_hoare_, suffix##_8)                         \
+    IMPORT_MEDIAN_SORT(type_t, less_than, 4,                                    \
+                       prefix##auto_block_partition##suffix,                    \
+                       prefix##auto_block_, suffix##_4)                         \
+    IMPORT_MEDIAN_SORT(type_t, less_than, 5,                                    \
+                       prefix##auto_block_partition##suffix,                    \
+                       prefix##auto_block_, suffix##_5)                         \
+    IMPORT_MEDIAN_SORT(type_t, less_than, 6,                                    \
+                       prefix##auto_block_partition##suffix,                    \
+                       prefix##auto_block_, suffix##_6)                         \
+    IMPORT_MEDIAN_SORT(type_t, less_than, 7,                                    \
+                       prefix##auto_block_partition##suffix,                    \
+                       prefix##auto_block_, suffix##_7)                         \
+    IMPORT_MEDIAN_SORT(type_t, less_than, 8,                                    \
+                       prefix##auto_block_partition##suffix,                    \
+                       prefix##auto_block_, suffix##_8)                         \
+                                                                                \
+    static void (*const prefix##median_auto_sorts##suffix[TUNING_CONFIGS])(     \
+            type_t *, const size_t) = {                                         \
+        prefix##auto_hoare_median_sort##suffix##_4,                             \
+        prefix##auto_hoare_median_sort##suffix##_5,                             \
+        prefix##auto_hoare_median_sort##suffix##_6,                             \
+        prefix##auto_hoare_median_sort##suffix##_7,                             \
+        prefix##auto_hoare_median_sort##suffix##_8,                             \
+        prefix##auto_block_median_sort##suffix##_4,                             \
+        prefix##auto_block_median_sort##suffix##_5,                             \
+        prefix##auto_block_median_sort##suffix##_6,                             \
+        prefix##auto_block_median_sort##suffix##_7,                             \
+        prefix##auto_block_median_sort##suffix##_8                              \
+    };                                                                          \
+                                                                                \
+    static const char *const prefix##median_auto_names##suffix[] = {            \
+        "hoare_4", "hoare_5", "hoare_6", "hoare_7", "hoare_8",                  \
+        "block_4", "block_5", "block_6", "block_7", "block_8"                   \
+    };                                                                          \
+                                                                                \
+    static unsigned char prefix##median_tuning##suffix[TUNING_CLASSES] = {      \
+        TUNING_DEFAULT, TUNING_DEFAULT, TUNING_DEFAULT, TUNING_DEFAULT,         \
+        TUNING_DEFAULT, TUNING_DEFAULT, TUNING_DEFAULT, TUNING_DEFAULT,         \
+        TUNING_DEFAULT, TUNING_DEFAULT, TUNING_DEFAULT, TUNING_DEFAULT,         \
+        TUNING_DEFAULT, TUNING_DEFAULT, TUNING_DEFAULT, TUNING_DEFAULT,         \
+        TUNING_DEFAULT, TUNING_DEFAULT, TUNING_DEFAULT, TUNING_DEFAULT,         \
+        TUNING_DEFAULT, TUNING_DEFAULT, TUNING_DEFAULT, TUNING_DEFAULT,         \
+        TUNING_DEFAULT, TUNING_DEFAULT, TUNING_DEFAULT, TUNING_DEFAULT,         \
+        TUNING_DEFAULT, TUNING_DEFAULT, TUNING_DEFAULT, TUNING_DEFAULT,         \
+        TUNING_DEFAULT, TUNING_DEFAULT, TUNING_DEFAULT, TUNING_DEFAULT,         \
+        TUNING_DEFAULT, TUNING_DEFAULT, TUNING_DEFAULT, TUNING_DEFAULT,         \
+        TUNING_DEFAULT, TUNING_DEFAULT, TUNING_DEFAULT, TUNING_DEFAULT,         \
+        TUNING_DEFAULT, TUNING_DEFAULT, TUNING_DEFAULT, TUNING_DEFAULT,         \
+        TUNING_DEFAULT, TUNING_DEFAULT, TUNING_DEFAULT, TUNING_DEFAULT,         \
+        TUNING_DEFAULT, TUNING_DEFAULT, TUNING_DEFAULT, TUNING_DEFAULT,         \
+        TUNING_DEFAULT, TUNING_DEFAULT, TUNING_DEFAULT, TUNING_DEFAULT,         \
+        TUNING_DEFAULT, TUNING_DEFAULT, TUNING_DEFAULT, TUNING_DEFAULT          \
+    };                                                                          \
+                                                                                \
+    static inline size_t prefix##median_auto_class##suffix(size_t length) {     \
+        size_t k;                                                               \
+        for (k = 0; length > 1; length >>= 1) { ++k; }                          \
+        return k;                                                               \
+    }                                                                           \
+                                                                                \
+    static inline const char *prefix##median_auto_config##suffix(               \
+            const size_t length) {                                              \
+        const size_t k = prefix##median_auto_class##suffix(length);             \
+        return prefix##median_auto_names##suffix[                               \
+                   TUNING_GET(prefix##median_tuning##suffix[k])];               \
+    }                                                                           \
+                                                                                \
+    static void prefix##median_sort_auto##suffix(type_t *A,                     \
+                                                 const size_t length) {         \
+        const size_t k = prefix##median_auto_class##suffix(length);             \
+        prefix##median_auto_sorts##suffix[                                      \
+            TUNING_GET(prefix##median_tuning##suffix[k])](A, length);           \
+    }                                                                           \
+                                                                                \
+    static void prefix##median_sort_calibrate##suffix(const type_t *A,          \
+                                                      const size_t length) {    \
+                                                                                \
+        type_t *B = malloc(length * sizeof(type_t));                            \
+        double start, time, best[TUNING_CONFIGS];                               \
+        size_t c, k, n, i, w, rounds, last = TUNING_CLASSES;                    \
+        unsigned char table[TUNING_CLASSES];                                    \
+                                                                                \
+        /* Without memory for the copies the table is left as it is */          \
+        if (B == NULL && length > 0) { return; }                                \
+                                                                                \
+        /* Filled in a copy, which is then published entry by entry */          \
+        for (k = 0; k < TUNING_CLASSES; ++k) {                                  \
+            table[k] = TUNING_GET(prefix##median_tuning##suffix[k]);            \
+        }                                                                       \
+                                                                                \
+        /* Time every configuration on each prefix of length 2^k */             \
+        for (k = TUNING_MINIMUM; k < TUNING_CLASSES; ++k) {                     \
+            n = (size_t) 1 << k;                                                \
+            if (n > length) { break; }                                          \
+            rounds = k < TUNING_BUDGET ? (size_t) 1 << (TUNING_BUDGET-k) : 1;   \
+            for (w = 0, c = 0; c < TUNING_CONFIGS; ++c) {                       \
+                for (best[c] = 0.0, i = 0; i < rounds; ++i) {                   \
+                    memcpy(B, A, n * sizeof(type_t));                           \
+                    start = wall_clock();                                       \
+                    prefix##median_auto_sorts##suffix[c](B, n);                 \
+                    time = wall_clock() - start;                                \
+                    if (i == 0 || time < best[c]) { best[c] = time; }           \
+                }                                                               \
+                if (best[c] < best[w]) { w = c; }                               \
+            }                                                                   \
+            table[k] = (unsigned char) w;                                       \
+            last = k;                                                           \
+        }                                                                       \
+                                                                                \
+        /* Shorter and longer classes reuse the closest timed one */            \
+        if (last < TUNING_CLASSES) {                                            \
+            for (k = 0; k < TUNING_MINIMUM; ++k) {                              \
+                table[k] = table[TUNING_MINIMUM];                               \
+            }                                                                   \
+            for (k = last+1; k < TUNING_CLASSES; ++k) {                         \
+                table[k] = table[last];                                         \
+            }                                                                   \
+        }                                                                       \
+        for (k = 0; k < TUNING_CLASSES; ++k) {                                  \
+            TUNING_SET(prefix##median_tuning##suffix[k], table[k]);             \
+        }                                                                       \
+                                                                                \
+        free(B);                                                                \
+    }                                                                           \
+                                                                                \
+    static inline int prefix##median_tuning_save##suffix(const char *path) {    \
+                                                                                \
+        FILE *file = fopen(path, "w");                                          \
+        size_t k, c;                                                            \
+        int error;                                                              \
+                                                                                \
+        if (file == NULL) { return -1; }                                        \
+        error = fprintf(file, "MedianSort tuning %zu %s\n",                     \
+                        sizeof(type_t), #type_t) < 0;                           \
+        for (k = 0; k < TUNING_CLASSES; ++k) {                                  \
+            c = TUNING_GET(prefix##median_tuning##suffix[k]);                   \
+            error |= fprintf(file, "%zu %s\n", k,                               \
+                             prefix##median_auto_names##suffix[c]) < 0;         \
+        }                                                                       \
+        error |= fclose(file) != 0;                                             \
+        return error ? -1 : 0;                                                  \
+    }                                                                           \
+                                                                                \
+    static inline int prefix##median_tuning_load##suffix(const char *path) {    \
+                                                                                \
+        unsigned char table[TUNING_CLASSES];                                    \
+        char name[64], line[128], head[128];                                    \
+        FILE *file = fopen(path, "r");                                          \
+        size_t c, k, i;                                                         \
+        int ok;                                                                 \
+                                                                                \
+        if (file == NULL) { return -1; }                                        \
+        snprintf(head, sizeof(head), "MedianSort tuning %zu %s\n",              \
+                 sizeof(type_t), #type_t);                                      \
+        ok = fgets(line, sizeof(line), file) && strcmp(line, head) == 0;        \
+        for (k = 0; ok && k < TUNING_CLASSES; ++k) {                            \
+            ok = fscanf(file, "%zu %63s", &i, name) == 2 && i == k;             \
+            for (c = 0; ok && c < TUNING_CONFIGS; ++c) {                        \
+                if (strcmp(name, prefix##median_auto_names##suffix[c]) == 0) {  \
+                    break;                                                      \
+                }                                                               \
+            }                                                                   \
+            ok = ok && c < TUNING_CONFIGS;                                      \
+            table[k] = (unsigned char) c;                                       \
+        }                                                                       \
+        fclose(file);                                                           \
+        if (!ok) { return -1; }                                                 \
+        for (k = 0; k < TUNING_CLASSES; ++k) {                                  \
+            TUNING_SET(prefix##median_tuning##suffix[k], table[k]);             \
+        }                                                                       \
+        return 0;                                                               \
+    }                                                                           \
+                                                                                \
+
+#define IMPORT_QUICK_SORT(type_t, less_than, power, partition, prefix, suffix)  \
+                                                                                \
+    static void prefix##quick_sort##suffix(type_t *A, const size_t length) {    \
+                                                                                \
+        size_t l, r;                                                            \
+        type_t t;                                                               \
+                                                                                \
+        /* QUICK SORT (down to 2^power intervals) */                            \
+        if (length > (1 << power)) {                                            \
+            INSTRUMENT_BEGIN(length, 0);                                        \
+            partition(A, length, length/2, &l, &r);                             \
+            INSTRUMENT_END(length, 0);                                          \
+            prefix##quick_sort##suffix(A,   l);                                 \
+            prefix##quick_sort##suffix(A+r, length-r);                          \
+        }                                                                       \
+                                                                                \
+        /* INSERTION SORT (up to 2^power distances) */                          \
+        else {                                                                  \
+            INSTRUMENT_BEGIN(length, 1);                                        \
+            for (r = 1; r < length; ++r) {                                      \
+                t = A[r];                                                       \
+                for (l=r; l && less_than(t, A[l-1]); --l) {                     \
+                    A[l] = A[l-1]; COUNT_SWAPS(1);                              \
+                }                                                               \
+                A[l] = t;                                                       \
+            }                                                                   \
+            INSTRUMENT_END(length, 1);                                          \
+        }                                                                       \
+    }                                                                           \
+                                                                                \
+
+#define IMPORT_HEAP_SORT(type_t, less_than, prefix, suffix)                     \
+                                                                                \
+    static void prefix##heap_sort##suffix(type_t *A, const size_t length) {     \
+                                                                                \
+        size_t i, j, k;                                                         \
+        type_t temp;                                                            \
+                                                                                \
+        for (i = (length>>1); i--> 0; ) {                                       \
+            temp = A[i];                                                        \
+            for (j = i, k = (i<<1)+1; k < length; k = (j<<1)+1) {               \
+                if (k+1 < length && less_than(A[k], A[k+1])) { ++k; }           \
+                if (less_than(temp, A[k])) { A[j] = A[k]; j = k; }              \
+                else                       { break;              }              \
+            }                                                                   \
+            A[j] = temp;                                                        \
+        }                                                                       \
+                                                                                \
+        for (i = length; i--> 1; ) {                                            \
+            temp = A[i];                                                        \
+            A[i] = A[0];                                                        \
+            for (j = 0, k = 1; k < i; k = (j<<1)+1) {                           \
+                if (k+1 < i && less_than(A[k], A[k+1])) { ++k; }                \
+                if (less_than(temp, A[k])) { A[j] = A[k]; j = k; }              \
+                else                       { break;              }              \
+            }                                                                   \
+            A[j] = temp;                                                        \
+        }                                                                       \
+    }                                                                           \
+                                                                                \
+
+#define IMPORT_SHELL_SORT(type_t, less_than, prefix, suffix)                    \
+                                                                                \
+    static void prefix##shell_sort##suffix(type_t *A, const size_t length) {    \
+                                                                                \
+        /* The first 54 gaps of Tokuda's sequence: ceil((9*((9/4)^n)-4)/5) */   \
+        /* Enough for 64 bit machines. Pre-computed for efficiency.        */   \
+        const size_t gaps[54] = {1u, 4u, 9u, 20u, 46u, 103u, 233u, 525u, 1182u, \
+                                 2660u, 5985u, 13467u, 30301u, 68178u, 153401u, \
+                                 345152u, 776591u, 1747331u, 3931496u,          \
+                                 8845866u, 19903198u, 44782196u, 100759940u,    \
+                                 226709866u, 510097200u, 1147718700u,           \
+                                 2582367076u, 5810325920u, 13073233321u,        \
+                                 29414774973u, 66183243690u, 148912298303u,     \
+                                 335052671183u, 753868510162u, 1696204147864u,  \
+                                 3816459332694u, 8587033498562u,                \
+                                 19320825371765u, 43471857086472u,              \
+                                 97811678444563u, 220076276500268u,             \
+                                 495171622125603u, 1114136149782608u,           \
+                                 2506806337010868u, 5640314258274455u,          \
+                                 12690707081117524u, 28554090932514432u,        \
+                                 64246704598157464u, 144555085345854304u,       \
+                                 325248942028172160u, 731810119563387392u,      \
+                                 1646572769017621760u, 3704788730289648640u,    \
+                                 8335774643151711232u };                        \
+                                                                                \
+        size_t i, l, r, gap;                                                    \
+        type_t temp;                                                            \
+                                                                                \
+        /* Find the starting gap */                                             \
+        for (i = 1; i < 54 && gaps[i] < length; ++i);                           \
+                                                                                \
+        /* Shell Sort */                                                        \
+        do {gap = gaps[--i];                                                    \
+            for (r = gap; r < length; ++r) {                                    \
+                temp = A[r];                                                    \
+                l    = r;                                                       \
+                while (less_than(temp, A[l-gap])) {                             \
+                    A[l] = A[l-gap];                                            \
+                    l   -= gap;                                                 \
+                    if (l < gap) { break; }                                     \
+                }                                                               \
+                A[l] = temp;                                                    \
+            }                                                                   \
+        } while (gap > 1);                                                      \
+    }                                                                           \
+                                                                                \
+
+
+/** VECTORIZED PARTITION FUNCTIONS **************************************** **/
+
+/* For primitive keys, partition can also be done with SIMD instructions:   */
+/* each vector of keys is compared against the pivot at once and its lanes   */
+/* are written out to the left and right ends of the interval (AVX-512 has   */
+/* compress-store instructions, AVX2 uses a table of permutations instead).  */
+/* IMPORT_SIMD_MEDIAN_SORT(type_t, power, key) creates median_sort_<key>     */
+/* (and median_quantiles_<key>) that picks the _avx512, the _avx2 or (if     */
+/* none of them is available) the _generic version the first time it runs.   */
+/* The dispatch (simd_level) also fills the AVX2 permutation tables, so the  */
+/* kernels themselves never check them: call the _avx2 and _avx512 versions  */
+/* only after median_sort_<key> or median_quantiles_<key> has run once.      */
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+
+#include <immintrin.h>  /* AVX2 and AVX-512 intrinsics.                      */
+
+#define avx2_target   __attribute__((target("avx2,popcnt")))
+#define avx512_target __attribute__((target("avx512f,popcnt")))
+
+static pthread_once_t simd_once = PTHREAD_ONCE_INIT;
+static int            simd_isa  = 0;    /* 0: none, 1: AVX2, 2: AVX-512      */
+
+static int32_t avx2_perm_32[256][8];    /* Lanes of the mask first (32 bits) */
+static int32_t avx2_perm_64[ 16][8];    /* Lanes of the mask first (64 bits) */
+
+static void simd_init(void) {
+
+    int i, j, k, b;
+
+    for (i = 0; i < 256; ++i) {
+        for (k = 0, b = 1; b >= 0; --b) {
+            for (j = 0; j < 8; ++j) {
+                if (((i >> j) & 1) == b) { avx2_perm_32[i][k++] = j; }
+            }
+        }
+    }
+    for (i = 0; i < 16; ++i) {
+        for (k = 0, b = 1; b >= 0; --b) {
+            for (j = 0; j < 4; ++j) {
+                if (((i >> j) & 1) == b) { avx2_perm_64[i][k++] = 2*j;
+                                           avx2_perm_64[i][k++] = 2*j+1; }
+            }
+        }
+    }
+
+    __builtin_cpu_init();
+    if      (__builtin_cpu_supports("avx512f")) { simd_isa = 2; }
+    else if (__builtin_cpu_supports("avx2"))    { simd_isa = 1; }
+}
+
+static int simd_level(void) {
+    pthread_once(&simd_once, &simd_init);
+    return simd_isa;
+}
+
+static avx2_target __m256i avx2_perm(const int32_t *T) {
+    return _mm256_loadu_si256((const __m256i *) (const void *) T);
+}
+
+/* AVX2 helpers: set1, loadu, mask of the lanes < p (or <= p) and store of  */
+/* the masked lanes at L and of the rest right before R (permutation table) */
+
+static avx2_target __m256i avx2_set1_i32(const int32_t p) {
+    return _mm256_set1_epi32(p);
+}
+static avx2_target __m256i avx2_loadu_i32(const int32_t *A) {
+    return _mm256_loadu_si256((const __m256i *) (const void *) A);
+}
+static avx2_target unsigned avx2_mask_i32(__m256i v, __m256i p, int le) {
+    __m256i m = le ? _mm256_cmpgt_epi32(v, p) : _mm256_cmpgt_epi32(p, v);
+    unsigned k = (unsigned) _mm256_movemask_ps(_mm256_castsi256_ps(m));
+    return le ? ~k & 0xFFu : k;
+}
+static avx2_target size_t avx2_store_i32(int32_t *L, int32_t *R, __m256i v,
+                                         unsigned mask) {
+    v = _mm256_permutevar8x32_epi32(v, avx2_perm(avx2_perm_32[mask]));
+    _mm256_storeu_si256((__m256i *) (void *) L,     v);
+    _mm256_storeu_si256((__m256i *) (void *) (R-8), v);
+    return (size_t) __builtin_popcount(mask);
+}
+
+static avx2_target __m256 avx2_set1_f32(const float p) {
+    return _mm256_set1_ps(p);
+}
+static avx2_target __m256 avx2_loadu_f32(const float *A) {
+    return _mm256_loadu_ps(A);
+}
+static avx2_target unsigned avx2_mask_f32(__m256 v, __m256 p, int le) {
+    __m256 m = le ? _mm256_cmp_ps(v, p, _CMP_LE_OQ)
+                  : _mm256_cmp_ps(v, p, _CMP_LT_OQ);
+    return (unsigned) _mm256_movemask_ps(m);
+}
+static avx2_target size_t avx2_store_f32(float *L, float *R, __m256 v,
+                                         unsigned mask) {
+    v = _mm256_permutevar8x32_ps(v, avx2_perm(avx2_perm_32[mask]));
+    _mm256_storeu_ps(L,     v);
+    _mm256_storeu_ps(R - 8, v);
+    return (size_t) __builtin_popcount(mask);
+}
+
+static avx2_target __m256i avx2_set1_i64(const int64_t p) {
+    return _mm256_set1_epi64x(p);
+}
+static avx2_target __m256i avx2_loadu_i64(const int64_t *A) {
+    return _mm256_loadu_si256((const __m256i *) (const void *) A);
+}
+static avx2_target unsigned avx2_mask_i64(__m256i v, __m256i p, int le) {
+    __m256i m = le ? _mm256_cmpgt_epi64(v, p) : _mm256_cmpgt_epi64(p, v);
+    unsigned k = (unsigned) _mm256_movemask_pd(_mm256_castsi256_pd(m));
+    return le ? ~k & 0xFu : k;
+}
+static avx2_target size_t avx2_store_i64(int64_t *L, int64_t *R, __m256i v,
+                                         unsigned mask) {
+    v = _mm256_permutevar8x32_epi32(v, avx2_perm(avx2_perm_64[mask]));
+    _mm256_storeu_si256((__m256i *) (void *) L,     v);
+    _mm256_storeu_si256((__m256i *) (void *) (R-4), v);
+    return (size_t) __builtin_popcount(mask);
+}
+
+static avx2_target __m256d avx2_set1_f64(const double p) {
+    return _mm256_set1_pd(p);
+}
+static avx2_target __m256d avx2_loadu_f64(const double *A) {
+    return _mm256_loadu_pd(A);
+}
+static avx2_target unsigned avx2_mask_f64(__m256d v, __m256d p, int le) {
+    __m256d m = le ? _mm256_cmp_pd(v, p, _CMP_LE_OQ)
+                   : _mm256_cmp_pd(v, p, _CMP_LT_OQ);
+    return (unsigned) _mm256_movemask_pd(m);
+}
+static avx2_target size_t avx2_store_f64(double *L, double *R, __m256d v,
+                                         unsigned mask) {
+    v = _mm256_castps_pd(_mm256_permutevar8x32_ps(_mm256_castpd_ps(v),
+                                              avx2_perm(avx2_perm_64[mask])));
+    _mm256_storeu_pd(L,     v);
+    _mm256_storeu_pd(R - 4, v);
+    return (size_t) __builtin_popcount(mask);
+}
+
+/* AVX-512 helpers: same as above, but with native compress-stores          */
+
+static avx512_target __m512i avx512_set1_i32(const int32_t p) {
+    return _mm512_set1_epi32(p);
+}
+static avx512_target __m512i avx512_loadu_i32(const int32_t *A) {
+    return _mm512_loadu_si512((const void *) A);
+}
+static avx512_target unsigned avx512_mask_i32(__m512i v, __m512i p, int le) {
+    return le ? _mm512_cmple_epi32_mask(v, p) : _mm512_cmplt_epi32_mask(v, p);
+}
+static avx512_target size_t avx512_store_i32(int32_t *L, int32_t *R,
+                                             __m512i v, unsigned mask) {
+    const size_t k = (size_t) __builtin_popcount(mask);
+    _mm512_mask_compressstoreu_epi32(L,          (__mmask16)  mask, v);
+    _mm512_mask_compressstoreu_epi32(R - (16-k), (__mmask16) ~mask, v);
+    return k;
+}
+
+static avx512_target __m512 avx512_set1_f32(const float p) {
+    return _mm512_set1_ps(p);
+}
+static avx512_target __m512 avx512_loadu_f32(const float *A) {
+    return _mm512_loadu_ps(A);
+}
+static avx512_target unsigned avx512_mask_f32(__m512 v, __m512 p, int le) {
+    return le ? _mm512_cmp_ps_mask(v, p, _CMP_LE_OQ)
+              : _mm512_cmp_ps_mask(v, p, _CMP_LT_OQ);
+}
+static avx512_target size_t avx512_store_f32(float *L, float *R, __m512 v,
+                                             unsigned mask) {
+    const size_t k = (size_t) __builtin_popcount(mask);
+    _mm512_mask_compressstoreu_ps(L,          (__mmask16)  mask, v);
+    _mm512_mask_compressstoreu_ps(R - (16-k), (__mmask16) ~mask, v);
+    return k;
+}
+
+static avx512_target __m512i avx512_set1_i64(const int64_t p) {
+    return _mm512_set1_epi64(p);
+}
+static avx512_target __m512i avx512_loadu_i64(const int64_t *A) {
+    return _mm512_loadu_si512((const void *) A);
+}
+static avx512_target unsigned avx512_mask_i64(__m512i v, __m512i p, int le) {
+    return le ? _mm512_cmple_epi64_mask(v, p) : _mm512_cmplt_epi64_mask(v, p);
+}
+static avx512_target size_t avx512_store_i64(int64_t *L, int64_t *R,
+                                             __m512i v, unsigned mask) {
+    const size_t k = (size_t) __builtin_popcount(mask);
+    _mm512_mask_compressstoreu_epi64(L,         (__mmask8)  mask, v);
+    _mm512_mask_compressstoreu_epi64(R - (8-k), (__mmask8) ~mask, v);
+    return k;
+}
+
+static avx512_target __m512d avx512_set1_f64(const double p) {
+    return _mm512_set1_pd(p);
+}
+static avx512_target __m512d avx512_loadu_f64(const double *A) {
+    return _mm512_loadu_pd(A);
+}
+static avx512_target unsigned avx512_mask_f64(__m512d v, __m512d p, int le) {
+    return le ? _mm512_cmp_pd_mask(v, p, _CMP_LE_OQ)
+              : _mm512_cmp_pd_mask(v, p, _CMP_LT_OQ);
+}
+static avx512_target size_t avx512_store_f64(double *L, double *R, __m512d v,
+                                             unsigned mask) {
+    const size_t k = (size_t) __builtin_popcount(mask);
+    _mm512_mask_compressstoreu_pd(L,         (__mmask8)  mask, v);
+    _mm512_mask_compressstoreu_pd(R - (8-k), (__mmask8) ~mask, v);
+    return k;
+}
+
+#define IMPORT_SIMD_PARTITION(type_t, vec_t, lanes, isa, key)                   \
+                                                                                \
+    static isa##_target size_t isa##_split_##key(type_t *A,                     \
+                                                 const size_t length,           \
+                                                 const type_t p,                \
+                                                 const int le) {                \
+                                                                                \
+        type_t buffer[3*lanes], t;                                              \
+        vec_t  v, vp = isa##_set1_##key(p);                                     \
+                                                                                \
+        size_t i, n, b = length;                                                \
+        size_t l_read = 0, r_read = length, l_write = 0, r_write = length;      \
+                                                                                \
+        /* Buffer both ends, so that there is room for a vector on each side */ \
+        if (length >= 2*lanes) {                                                \
+            memcpy(buffer,       A,              lanes * sizeof(type_t));       \
+            memcpy(buffer+lanes, A+length-lanes, lanes * sizeof(type_t));       \
+            l_read += lanes;                                                    \
+            r_read -= lanes;                                                    \
+                                                                                \
+            /* Read from the side with less room and write to both sides */     \
+            while (r_read - l_read >= lanes) {                                  \
+                if (l_read - l_write <= r_write - r_read) {                     \
+                    v = isa##_loadu_##key(A+l_read); l_read += lanes;           \
+                } else {                                                        \
+                    r_read -= lanes; v = isa##_loadu_##key(A+r_read);           \
+                }                                                               \
+                n = isa##_store_##key(A+l_write, A+r_write, v,                  \
+                                      isa##_mask_##key(v, vp, le));             \
+                l_write += n;                                                   \
+                r_write -= lanes-n;                                             \
+            }                                                                   \
+                                                                                \
+            b = 2*lanes + (r_read-l_read);                                      \
+            memcpy(buffer+2*lanes, A+l_read, (r_read-l_read) * sizeof(type_t)); \
+        }                                                                       \
+        else { memcpy(buffer, A, length * sizeof(type_t)); }                    \
+                                                                                \
+        /* Write the buffered elements one by one */                            \
+        for (i = 0; i < b; ++i) {                                               \
+            t = buffer[i];                                                      \
+            if (le ? t <= p : t < p) { A[l_write++] = t; }                      \
+            else                     { A[--r_write] = t; }                      \
+        }                                                                       \
+        return l_write;                                                         \
+    }                                                                           \
+                                                                                \
+    static isa##_target void isa##_partition_##key(type_t *A,                   \
+                                                   const size_t length,         \
+                                                   const size_t pivot,          \
+                                                   size_t *lo, size_t *hi) {    \
+        const type_t p = A[pivot];                                              \
+        size_t m, e;                                                            \
+                                                                                \
+        /* Keep the pivot at the end and split the rest by A[i] < p */          \
+        A[pivot] = A[length-1]; A[length-1] = p;                                \
+        m = e = isa##_split_##key(A, length-1, p, 0);                           \
+                                                                                \
+        /* On unbalanced splits, gather the copies of the pivot too */          \
+        if (m < length/8) { e += isa##_split_##key(A+m, length-1-m, p, 1); }    \
+                                                                                \
+        /* Put the pivot in its place */                                        \
+        A[length-1] = A[e]; A[e] = p;                                           \
+                                                                                \
+        *lo = m;                                                                \
+        *hi = e+1;                                                              \
+    }                                                                           \
+                                                                                \
+
+IMPORT_SIMD_PARTITION(int32_t, __m256i,  8, avx2,   i32)
+IMPORT_SIMD_PARTITION(float,   __m256,   8, avx2,   f32)
+IMPORT_SIMD_PARTITION(int64_t, __m256i,  4, avx2,   i64)
+IMPORT_SIMD_PARTITION(double,  __m256d,  4, avx2,   f64)
+IMPORT_SIMD_PARTITION(int32_t, __m512i, 16, avx512, i32)
+IMPORT_SIMD_PARTITION(float,   __m512,  16, avx512, f32)
+IMPORT_SIMD_PARTITION(int64_t, __m512i,  8, avx512, i64)
+IMPORT_SIMD_PARTITION(double,  __m512d,  8, avx512, f64)
+
+#define IMPORT_SIMD_MEDIAN_SORT(type_t, power, key)                             \
+                                                                                \
+    IMPORT_BLOCK_PARTITION(type_t, LESS_THAN, , _##key)                         \
+    IMPORT_MEDIAN_SORT(type_t, LESS_THAN, power, block_partition_##key,         \
+                       , _##key##_generic)                                      \
+    IMPORT_MEDIAN_SORT(type_t, LESS_THAN, power, avx2_partition_##key,          \
+                       , _##key##_avx2)                                         \
+    IMPORT_MEDIAN_SORT(type_t, LESS_THAN, power, avx512_partition_##key,        \
+                       , _##key##_avx512)                                       \
+                                                                                \
+    static inline void median_sort_##key(type_t *A, const size_t length) {      \
+        switch (simd_level()) {                                                 \
+            case 2:  median_sort_##key##_avx512(A, length);  break;             \
+            case 1:  median_sort_##key##_avx2(A, length);    break;             \
+            default: median_sort_##key##_generic(A, length); break;             \
+        }                                                                       \
+    }                                                                           \
+                                                                                \
+    static inline size_t median_quantiles_##key(type_t *A,                      \
+                                                const size_t length,            \
+                                                size_t *ranks,                  \
+                                                const size_t k) {               \
+        switch (simd_level()) {                                                 \
+            case 2:  return median_quantiles_##key##_avx512(A, length,          \
+                                                            ranks, k);          \
+            case 1:  return median_quantiles_##key##_avx2(A, length,            \
+                                                          ranks, k);            \
+            default: return median_quantiles_##key##_generic(A, length,         \
+                                                             ranks, k);         \
+        }                                                                       \
+    }                                                                           \
+                                                                                \
+
+#else
+
+#define IMPORT_SIMD_MEDIAN_SORT(type_t, power, key)                             \
+                                                                                \
+    IMPORT_BLOCK_PARTITION(type_t, LESS_THAN, , _##key)                         \
+    IMPORT_MEDIAN_SORT(type_t, LESS_THAN, power, block_partition_##key,         \
+                       , _##key##_generic)                                      \
+                                                                                \
+    static inline void median_sort_##key(type_t *A, const size_t length) {      \
+        median_sort_##key##_generic(A, length);                                 \
+    }                                                                           \
+                                                                                \
+    static inline size_t median_quantiles_##key(type_t *A,                      \
+                                                const size_t length,            \
+                                                size_t *ranks,                  \
+                                                const size_t k) {               \
+        return median_quantiles_##key##_generic(A, length, ranks, k);           \
+    }                                                                           \
+                                                                                \
+
+#endif
+
+IMPORT_SIMD_MEDIAN_SORT(int32_t, 7, i32)
+IMPORT_SIMD_MEDIAN_SORT(float,   6, f32)
+IMPORT_SIMD_MEDIAN_SORT(int64_t, 7, i64)
+IMPORT_SIMD_MEDIAN_SORT(double,  6, f64)
+
+/** QSORT-COMPATIBLE INTERFACE ******************************************** **/
+
+/* median_sort_generic(base, n, size, cmp, ctx) sorts like qsort_r, so it    */
+/* can replace qsort in code that only knows the size of the elements. The   */
+/* comparator is kept in thread-local variables (saved and restored, so it   */
+/* can be nested) and records of 4, 8, 16 or 32 bytes are moved as a whole   */
+/* by the median_sort instantiated for them. Any other size is sorted as an  */
+/* array of indices and the records are then put in place with permute, so   */
+/* each record is moved just once (if there is no memory for the indices,    */
+/* the records are heap sorted in place, swapped through a bounded buffer).  */
+
+#define GENERIC_POWER 5
+
+typedef int (*generic_cmp_t)(const void *, const void *, void *);
+
+static __thread generic_cmp_t  generic_cmp  = NULL;
+static __thread void          *generic_ctx  = NULL;
+static __thread unsigned char *generic_base = NULL;
+static __thread size_t         generic_size = 0;
+
+#define GENERIC_LESS_THAN(i, j)  (generic_cmp(&(i), &(j), generic_ctx) < 0)
+#define INDIRECT_LESS_THAN(i, j) (generic_cmp(generic_base + (i)*generic_size,  \
+                                              generic_base + (j)*generic_size,  \
+                                              generic_ctx) < 0)
+
+typedef struct { unsigned char bytes[ 4]; } generic_4_t;
+typedef struct { unsigned char bytes[ 8]; } generic_8_t;
+typedef struct { unsigned char bytes[16]; } generic_16_t;
+typedef struct { unsigned char bytes[32]; } generic_32_t;
+
+IMPORT_BLOCK_PARTITION(generic_4_t,  GENERIC_LESS_THAN,  generic_, _4)
+IMPORT_BLOCK_PARTITION(generic_8_t,  GENERIC_LESS_THAN,  generic_, _8)
+IMPORT_BLOCK_PARTITION(generic_16_t, GENERIC_LESS_THAN,  generic_, _16)
+IMPORT_BLOCK_PARTITION(generic_32_t, GENERIC_LESS_THAN,  generic_, _32)
+IMPORT_BLOCK_PARTITION(size_t,       INDIRECT_LESS_THAN, generic_, _index)
+
+IMPORT_MEDIAN_SORT(generic_4_t,  GENERIC_LESS_THAN,  GENERIC_POWER,
+                   generic_block_partition_4,     generic_, _4)
+IMPORT_MEDIAN_SORT(generic_8_t,  GENERIC_LESS_THAN,  GENERIC_POWER,
+                   generic_block_partition_8,     generic_, _8)
+IMPORT_MEDIAN_SORT(generic_16_t, GENERIC_LESS_THAN,  GENERIC_POWER,
+                   generic_block_partition_16,    generic_, _16)
+IMPORT_MEDIAN_SORT(generic_32_t, GENERIC_LESS_THAN,  GENERIC_POWER,
+                   generic_block_partition_32,    generic_, _32)
+IMPORT_MEDIAN_SORT(size_t,       INDIRECT_LESS_THAN, GENERIC_POWER,
+                   generic_block_partition_index, generic_, _index)
+
+/* Sifts down the j-th record of the heap of the first n records */
+static void generic_sift_down(size_t j, const size_t n) {
+
+    size_t k;
+
+    for (k = (j<<1)+1; k < n; j = k, k = (j<<1)+1) {
+        if (k+1 < n && INDIRECT_LESS_THAN(k, k+1)) { ++k; }
+        if (!INDIRECT_LESS_THAN(j, k))             { break; }
+        swap_records(generic_base + j*generic_size,
+                     generic_base + k*generic_size, generic_size);
+    }
+}
+
+static void generic_indirect_sort(unsigned char *base, const size_t n,
+                                  const size_t size) {
+
+    unsigned char *const saved_base  = generic_base;
+    const size_t         saved_size  = generic_size;
+    size_t              *index       = malloc(n * sizeof(size_t));
+    size_t i;
+
+    generic_base = base;
+    generic_size = size;
+    if (index != NULL) {
+
+        /* Sort the indices and then move the records */
+        for (i = 0; i < n; ++i) { index[i] = i; }
+        generic_median_sort_index(index, n);
+        permute(base, n, size, index);
+        free(index);
+    } else {
+
+        /* Heap sort the records in place (no memory for the indices) */
+        for (i = n >> 1; i-- > 0; ) { generic_sift_down(i, n); }
+        for (i = n; i-- > 1; ) {
+            swap_records(base, base + i*size, size);
+            generic_sift_down(0, i);
+        }
+    }
+    generic_base = saved_base;
+    generic_size = saved_size;
+}
+
+void median_sort_generic(void *base, const size_t n, const size_t size,
+                         generic_cmp_t cmp, void *ctx) {
+
+    const generic_cmp_t saved_cmp = generic_cmp;
+    void *const         saved_ctx = generic_ctx;
+
+    if (n < 2 || size == 0) { return; }
+
+    generic_cmp = cmp;
+    generic_ctx = ctx;
+    switch (size) {
+        case  4: generic_median_sort_4((generic_4_t *) base, n);   break;
+        case  8: generic_median_sort_8((generic_8_t *) base, n);   break;
+        case 16: generic_median_sort_16((generic_16_t *) base, n); break;
+        case 32: generic_median_sort_32((generic_32_t *) base, n); break;
+        default: generic_indirect_sort(base, n, size);             break;
+    }
+    generic_cmp = saved_cmp;
+    generic_ctx = saved_ctx;
+}
+
+
+/* Everything below is the benchmark of this file: define                    */
+/* MEDIAN_SORT_TEMPLATES_ONLY before including it to get just the templates. */
+
+#ifndef MEDIAN_SORT_TEMPLATES_ONLY
+
+/** AUXILIARY FUNCTIONS *************************************************** **/
+
+int comp_int(const void *i, const void *j) {
+    int ii = *(int *) i;
+    int jj = *(int *) j;
+    return (((ii) > (jj)) - ((ii) < (jj)));
+}
+
+/* Records that are sorted by a small key */
+
+typedef struct { int key; unsigned char payload[ 60]; } record_64;
+typedef struct { int key; unsigned char payload[252]; } record_256;
+
+#define RECORD_LESS_THAN(i, j) ((i).key < (j).key)
+
+int comp_int_r(const void *i, const void *j, void *context) {
+    (void) context;
+    return comp_int(i, j);
+}
+
+int rand_int(const int n) {
+
+    /* Preconditions */
+    assert(n > 0);
+    assert(RAND_MAX >= n);
+
+    /* Monte-Carlo uniformly random generator */
+    int r, range = RAND_MAX - (RAND_MAX % n);
+    do { r = rand(); } while (r >= range);
+    return r % n;
+}
+
+/* McIlroy's adversary: "A Killer Adversary for Quicksort" (1999) */
+
+int *adversary_val;
+int  adversary_gas, adversary_solid, adversary_candidate;
+
+int adversary_comp(const int x, const int y) {
+
+    /* Values are only fixed ("frozen") when they are compared */
+    if (adversary_val[x] == adversary_gas && adversary_val[y] == adversary_gas) {
+        if (x == adversary_candidate) { adversary_val[x] = adversary_solid++; }
+        else                          { adversary_val[y] = adversary_solid++; }
+    }
+    if      (adversary_val[x] == adversary_gas) { adversary_candidate = x; }
+    else if (adversary_val[y] == adversary_gas) { adversary_candidate = y; }
+    return ((adversary_val[x] > adversary_val[y]) -
+            (adversary_val[x] < adversary_val[y]));
+}
+
+#define ADVERSARY_LESS_THAN(i, j) (adversary_comp((i), (j)) < 0)
+
+void adversary(int *A, int *index, const size_t n,
+               void (*sort)(int *, const size_t)) {
+
+    /* Builds in A the worst input of length n for the given sort */
+    size_t i;
+    adversary_val       = A;
+    adversary_gas       = (int) n;
+    adversary_solid     = 0;
+    adversary_candidate = 0;
+    for (i = 0; i < n; i++) { A[i] = adversary_gas; index[i] = (int) i; }
+    sort(index, n);
+}
+
+IMPORT_HOARE_PARTITION(int, LESS_THAN, , )
+IMPORT_BLOCK_PARTITION(int, LESS_THAN, , )
+IMPORT_FAT_PARTITION(int, LESS_THAN, , )
+
+IMPORT_MEDIAN_SORT(int, LESS_THAN, 0, hoare_partition, , _0)
+IMPORT_MEDIAN_SORT(int, LESS_THAN, 1, hoare_partition, , _1)
+IMPORT_MEDIAN_SORT(int, LESS_THAN, 2, hoare_partition, , _2)
+IMPORT_MEDIAN_SORT(int, LESS_THAN, 3, hoare_partition, , _3)
+IMPORT_MEDIAN_SORT(int, LESS_THAN, 4, hoare_partition, , _4)
+IMPORT_MEDIAN_SORT(int, LESS_THAN, 5, hoare_partition, , _5)
+IMPORT_MEDIAN_SORT(int, LESS_THAN, 6, hoare_partition, , _6)
+IMPORT_MEDIAN_SORT(int, LESS_THAN, 7, hoare_partition, , _7)
+IMPORT_MEDIAN_SORT(int, LESS_THAN, 8, hoare_partition, , _8)
+IMPORT_MEDIAN_SORT(int, LESS_THAN, 9, hoare_partition, , _9)
+
+IMPORT_MEDIAN_SORT(int, LESS_THAN, 0, block_partition, block_, _0)
+IMPORT_MEDIAN_SORT(int, LESS_THAN, 1, block_partition, block_, _1)
+IMPORT_MEDIAN_SORT(int, LESS_THAN, 2, block_partition, block_, _2)
+IMPORT_MEDIAN_SORT(int, LESS_THAN, 3, block_partition, block_, _3)
+IMPORT_MEDIAN_SORT(int, LESS_THAN, 4, block_partition, block_, _4)
+IMPORT_MEDIAN_SORT(int, LESS_THAN, 5, block_partition, block_, _5)
+IMPORT_MEDIAN_SORT(int, LESS_THAN, 6, block_partition, block_, _6)
+IMPORT_MEDIAN_SORT(int, LESS_THAN, 7, block_partition, block_, _7)
+IMPORT_MEDIAN_SORT(int, LESS_THAN, 8, block_partition, block_, _8)
+IMPORT_MEDIAN_SORT(int, LESS_THAN, 9, block_partition, block_, _9)
+
+IMPORT_MEDIAN_SORT(int, LESS_THAN, 7, fat_partition, fat_, _7)
+
+IMPORT_MEDIAN_ARGSORT(int, LESS_THAN, 5, , _5)
+IMPORT_MEDIAN_SORT_KV(int, , _5)
+IMPORT_MEDIAN_SORT_FILE(int, LESS_THAN, , _5)
+
+IMPORT_MEDIAN_SORT_AUTO(int, LESS_THAN, , )
+
+IMPORT_HOARE_PARTITION(record_64,  RECORD_LESS_THAN, record_, _64)
+IMPORT_HOARE_PARTITION(record_256, RECORD_LESS_THAN, record_, _256)
+
+IMPORT_MEDIAN_SORT(record_64,  RECORD_LESS_THAN, 7, record_hoare_partition_64,
+                   record_, _64)
+IMPORT_MEDIAN_SORT(record_256, RECORD_LESS_THAN, 7, record_hoare_partition_256,
+                   record_, _256)
+
+IMPORT_PARALLEL_MEDIAN_SORT(int, LESS_THAN, 7, , _7)
+
+IMPORT_MEDIAN_SORT_BATCH(int, LESS_THAN, , _7)
+
+IMPORT_QUICK_SORT(int, LESS_THAN, 0, hoare_partition, , _0)
+IMPORT_QUICK_SORT(int, LESS_THAN, 1, hoare_partition, , _1)
+IMPORT_QUICK_SORT(int, LESS_THAN, 2, hoare_partition, , _2)
+IMPORT_QUICK_SORT(int, LESS_THAN, 3, hoare_partition, , _3)
+IMPORT_QUICK_SORT(int, LESS_THAN, 4, hoare_partition, , _4)
+IMPORT_QUICK_SORT(int, LESS_THAN, 5, hoare_partition, , _5)
+IMPORT_QUICK_SORT(int, LESS_THAN, 6, hoare_partition, , _6)
+IMPORT_QUICK_SORT(int, LESS_THAN, 7, hoare_partition, , _7)
+IMPORT_QUICK_SORT(int, LESS_THAN, 8, hoare_partition, , _8)
+IMPORT_QUICK_SORT(int, LESS_THAN, 9, hoare_partition, , _9)
+
+IMPORT_QUICK_SORT(int, LESS_THAN, 0, block_partition, block_, _0)
+IMPORT_QUICK_SORT(int, LESS_THAN, 1, block_partition, block_, _1)
+IMPORT_QUICK_SORT(int, LESS_THAN, 2, block_partition, block_, _2)
+IMPORT_QUICK_SORT(int, LESS_THAN, 3, block_partition, block_, _3)
+IMPORT_QUICK_SORT(int, LESS_THAN, 4, block_partition, block_, _4)
+IMPORT_QUICK_SORT(int, LESS_THAN, 5, block_partition, block_, _5)
+IMPORT_QUICK_SORT(int, LESS_THAN, 6, block_partition, block_, _6)
+IMPORT_QUICK_SORT(int, LESS_THAN, 7, block_partition, block_, _7)
+IMPORT_QUICK_SORT(int, LESS_THAN, 8, block_partition, block_, _8)
+IMPORT_QUICK_SORT(int, LESS_THAN, 9, block_partition, block_, _9)
+
+IMPORT_HOARE_PARTITION(int, ADVERSARY_LESS_THAN, adversary_, )
+
+IMPORT_MEDIAN_SORT(int, ADVERSARY_LESS_THAN, 7, adversary_hoare_partition,
+                   adversary_, _7)
+IMPORT_QUICK_SORT(int, ADVERSARY_LESS_THAN, 7, adversary_hoare_partition,
+                  adversary_, _7)
+
+IMPORT_HEAP_SORT(int, LESS_THAN, , )
+
+IMPORT_SHELL_SORT(int, LESS_THAN, , )
+
+/** MAIN ****************************************************************** **/
+
+int main (void) {
+
+    clock_t crono;
+    double  start;
+    size_t  i, j, k, step, size, threads;
+
+    const size_t repeat = 100;
+    const size_t steps  = 6;
+
+    const long   online = sysconf(_SC_NPROCESSORS_ONLN);
+    const size_t cores  = online > 0 ? (size_t) online : 1;
+
+    double T[43][steps];
+    double P[64];
+    double W[4];
+    double V[8];
+    double C[2];
+    double R[4];
+    double Q[3];
+    size_t quantiles[4], touches;
+    double U[3], slice;
+    double F[6];
+    double G[8];
+    double H[5];
+    double X[3];
+    double Y[3];
+    double Z[6][3];
+    const double perturbed[6] = {0.0, 0.001, 0.01, 0.1, 1.0, -1.0};
+    double B[4][4];
+    const size_t widths[4] = {8, 32, 128, 512};
+    int   **batch;
+    size_t *lengths, count;
+    FILE  *file;
+    size_t moved;
+    int    failed;
+    record_64     *r64;
+    record_256    *r256;
+    unsigned char *bytes;
+    void          *payload;
+    size_t        *index, width;
+    median_state_7 state;
+    size_t S[steps];
+    for (step = 1, S[0] = 1000; step < steps; S[step] = S[step-1]*10, step++);
+
+    int *buffer = (int *) malloc(S[steps-1] * sizeof(int));  assert(buffer);
+    int *random = (int *) malloc(S[steps-1] * sizeof(int));  assert(random);
+    int *sorted = (int *) malloc(S[steps-1] * sizeof(int));  assert(sorted);
+    int *array  = (int *) malloc(S[steps-1] * sizeof(int));  assert(array);
+
+    void    *keys = malloc(S[steps-1] * sizeof(double));     assert(keys);
+    int32_t *i32  = (int32_t *) keys;
+    float   *f32  = (float   *) keys;
+    int64_t *i64  = (int64_t *) keys;
+    double  *f64  = (double  *) keys;
+
+    const size_t   record[4] = {4, 16, 32, 48};
+    unsigned char *records   = (unsigned char *) keys;
+
+#ifdef MEDIAN_SORT_INSTRUMENT
+
+    /*** PER LEVEL COUNTS (instead of the benchmark) *************************/
+
+    size = S[3];
+    for (i = 0; i < size; i++) { random[i] = rand_int(size); }
+    fprintf(stderr, "\nCOUNTING THE WORK OF EACH LEVEL ON %zu RANDOM INTS\n", size);
+
+    for (i = 0; i < size; i++) { array[i] = random[i]; }
+    instrument_reset();
+    median_sort_7(array, size);
+    instrument_report(stderr, "median_sort_7");
+    for (i = 1; i < size; i++) { assert(array[i-1] <= array[i]); }
+
+    for (i = 0; i < size; i++) { array[i] = random[i]; }
+    instrument_reset();
+    block_median_sort_7(array, size);
+    instrument_report(stderr, "block_median_sort_7");
+    for (i = 1; i < size; i++) { assert(array[i-1] <= array[i]); }
+
+    for (i = 0; i < size; i++) { array[i] = random[i]; }
+    instrument_reset();
+    quick_sort_7(array, size);
+    instrument_report(stderr, "quick_sort_7");
+    for (i = 1; i < size; i++) { assert(array[i-1] <= array[i]); }
+
+    for (i = 0; i < size; i++) { array[i] = random[i]; }
+    instrument_reset();
+    block_quick_sort_7(array, size);
+    instrument_report(stderr, "block_quick_sort_7");
+    for (i = 1; i < size; i++) { assert(array[i-1] <= array[i]); }
+
+    free(buffer);
+    free(random);
+    free(sorted);
+    free(array);
+    free(keys);
+
+    return 0;
+
+#endif
+
+    for (step = 0, size = 10; step < steps; step++) {
+
+        size = S[step];
+        for (i = 0; i < 43; i++) { T[i][step] = 0.0; }
+
+        fprintf(stderr, "\nSORTING %zu RANDOM INTS IN THE RANGE [0,%zu)\n", size, size);
+
+        for (j = 0; j < repeat; j++) {
+
+            /*** GENERATE INSTANCE *******************************************/
+
+            for (i = 0; i < size; i++) { random[i] = rand_int(size); }
+
+            /*** TEST QSORT **************************************************/
+
+            for (i = 0; i < size; i++) { sorted[i] = random[i]; }
+            crono = clock();
+            qsort(sorted, size, sizeof(int), &comp_int);
+            T[20][step] += ((double) (clock() - crono)) / CLOCKS_PER_SEC;
+            for (i = 1; i < size; i++) { assert(sorted[i-1] <= sorted[i]); }
+
+            /*** TEST HEAP SORT **********************************************/
+
+            for (i = 0; i < size; i++) { array[i] = random[i]; }
+            crono = clock();
+            heap_sort(array, size);
+            T[21][step] += ((double) (clock() - crono)) / CLOCKS_PER_SEC;
+            for (i = 0; i < size; i++) { assert(array[i] == sorted[i]); }
+
+            /*** TEST SHELL SORT *********************************************/
+
+            for (i = 0; i < size; i++) { array[i] = random[i]; }
+            crono = clock();
+            shell_sort(array, size);
+            T[22][step] += ((double) (clock() - crono)) / CLOCKS_PER_SEC;
+            for (i = 0; i < size; i++) { assert(array[i] == sorted[i]); }
+
+            /*** TEST MEDIAN SORT ********************************************/
+
+            for (i = 0; i < size; i++) { array[i] = random[i]; }
+            crono = clock();
+            median_sort_0(array, size);
+            T[0][step] += ((double) (clock() - crono)) / CLOCKS_PER_SEC;
+            for (i = 0; i < size; i++) { assert(array[i] == sorted[i]); }
+
+            for (i = 0; i < size; i++) { array[i] = random[i]; }
+            crono = clock();
+            median_sort_1(array, size);
+            T[1][step] += ((double) (clock() - crono)) / CLOCKS_PER_SEC;
+            for (i = 0; i < size; i++) { assert(array[i] == sorted[i]); }
+
+            for (i = 0; i < size; i++) { array[i] = random[i]; }
+            crono = clock();
+            median_sort_2(array, size);
+            T[2][step] += ((double) (clock() - crono)) / CLOCKS_PER_SEC;
+            for (i = 0; i < size; i++) { assert(array[i] == sorted[i]); }
+
+            for (i = 0; i < size; i++) { array[i] = random[i]; }
+            crono = clock();
+            median_sort_3(array, size);
+            T[3][step] += ((double) (clock() - crono)) / CLOCKS_PER_SEC;
+            for (i = 0; i < size; i++) { assert(array[i] == sorted[i]); }
+
+            for (i = 0; i < size; i++) { array[i] = random[i]; }
+            crono = clock();
+            median_sort_4(array, size);
+            T[4][step] += ((double) (clock() - crono)) / CLOCKS_PER_SEC;
+            for (i = 0; i < size; i++) { assert(array[i] == sorted[i]); }
+
+            for (i = 0; i < size; i++) { array[i] = random[i]; }
+            crono = clock();
+            median_sort_5(array, size);
+            T[5][step] += ((double) (clock() - crono)) / CLOCKS_PER_SEC;
+            for (i = 0; i < size; i++) { assert(array[i] == sorted[i]); }
+
+            for (i = 0; i < size; i++) { array[i] = random[i]; }
+            crono = clock();
+            median_sort_6(array, size);
+            T[6][step] += ((double) (clock() - crono)) / CLOCKS_PER_SEC;
+            for (i = 0; i < size; i++) { assert(array[i] == sorted[i]); }
+
+            for (i = 0; i < size; i++) { array[i] = random[i]; }
+            crono = clock();
+            median_sort_7(array, size);
+            T[7][step] += ((double) (clock() - crono)) / CLOCKS_PER_SEC;
+            for (i = 0; i < size; i++) { assert(array[i] == sorted[i]); }
+
+            for (i = 0; i < size; i++) { array[i] = random[i]; }
+            crono = clock();
+            median_sort_8(array, size);
+            T[8][step] += ((double) (clock() - crono)) / CLOCKS_PER_SEC;
+            for (i = 0; i < size; i++) { assert(array[i] == sorted[i]); }
+
+            for (i = 0; i < size; i++) { array[i] = random[i]; }
+            crono = clock();
+            median_sort_9(array, size);
+            T[9][step] += ((double) (clock() - crono)) / CLOCKS_PER_SEC;
+            for (i = 0; i < size; i++) { assert(array[i] == sorted[i]); }
+
+            /*** TEST QUICK SORT *********************************************/
+
+            for (i = 0; i < size; i++) { array[i] = random[i]; }
+            crono = clock();
+            quick_sort_0(array, size);
+            T[10][step] += ((double) (clock() - crono)) / CLOCKS_PER_SEC;
+            for (i = 0; i < size; i++) { assert(array[i] == sorted[i]); }
+
+            for (i = 0; i < size; i++) { array[i] = random[i]; }
+            crono = clock();
+            quick_sort_1(array, size);
+            T[11][step] += ((double) (clock() - crono)) / CLOCKS_PER_SEC;
+            for (i = 0; i < size; i++) { assert(array[i] == sorted[i]); }
+
+            for (i = 0; i < size; i++) { array[i] = random[i]; }
+            crono = clock();
+            quick_sort_2(array, size);
+            T[12][step] += ((double) (clock() - crono)) / CLOCKS_PER_SEC;
+            for (i = 0; i < size; i++) { assert(array[i] == sorted[i]); }
+
+            for (i = 0; i < size; i++) { array[i] = random[i]; }
+            crono = clock();
+            quick_sort_3(array, size);
+            T[13][step] += ((double) (clock() - crono)) / CLOCKS_PER_SEC;
+            for (i = 0; i < size; i++) { assert(array[i] == sorted[i]); }
+
+            for (i = 0; i < size; i++) { array[i] = random[i]; }
+            crono = clock();
+            quick_sort_4(array, size);
+            T[14][step] += ((double) (clock() - crono)) / CLOCKS_PER_SEC;
+            for (i = 0; i < size; i++) { assert(array[i] == sorted[i]); }
+
+            for (i = 0; i < size; i++) { array[i] = random[i]; }
+            crono = clock();
+            quick_sort_5(array, size);
+            T[15][step] += ((double) (clock() - crono)) / CLOCKS_PER_SEC;
+            for (i = 0; i < size; i++) { assert(array[i] == sorted[i]); }
+
+            for (i = 0; i < size; i++) { array[i] = random[i]; }
+            crono = clock();
+            quick_sort_6(array, size);
+            T[16][step] += ((double) (clock() - crono)) / CLOCKS_PER_SEC;
+            for (i = 0; i < size; i++) { assert(array[i] == sorted[i]); }
+
+            for (i = 0; i < size; i++) { array[i] = random[i]; }
+            crono = clock();
+            quick_sort_7(array, size);
+            T[17][step] += ((double) (clock() - crono)) / CLOCKS_PER_SEC;
+            for (i = 0; i < size; i++) { assert(array[i] == sorted[i]); }
+
+            for (i = 0; i < size; i++) { array[i] = random[i]; }
+            crono = clock();
+            quick_sort_8(array, size);
+            T[18][step] += ((double) (clock() - crono)) / CLOCKS_PER_SEC;
+            for (i = 0; i < size; i++) { assert(array[i] == sorted[i]); }
+
+            for (i = 0; i < size; i++) { array[i] = random[i]; }
+            crono = clock();
+            quick_sort_9(array, size);
+            T[19][step] += ((double) (clock() - crono)) / CLOCKS_PER_SEC;
+            for (i = 0; i < size; i++) { assert(array[i] == sorted[i]); }
+
+            /*** TEST BLOCK MEDIAN SORT **************************************/
+
+            for (i = 0; i < size; i++) { array[i] = random[i]; }
+            crono = clock();
+            block_median_sort_0(array, size);
+            T[23][step] += ((double) (clock() - crono)) / CLOCKS_PER_SEC;
+            for (i = 0; i < size; i++) { assert(array[i] == sorted[i]); }
+
+            for (i = 0; i < size; i++) { array[i] = random[i]; }
+            crono = clock();
+            block_median_sort_1(array, size);
+            T[24][step] += ((double) (clock() - crono)) / CLOCKS_PER_SEC;
+            for (i = 0; i < size; i++) { assert(array[i] == sorted[i]); }
+
+            for (i = 0; i < size; i++) { array[i] = random[i]; }
+            crono = clock();
+            block_median_sort_2(array, size);
+            T[25][step] += ((double) (clock() - crono)) / CLOCKS_PER_SEC;
+            for (i = 0; i < size; i++) { assert(array[i] == sorted[i]); }
+
+            for (i = 0; i < size; i++) { array[i] = random[i]; }
+            crono = clock();
+            block_median_sort_3(array, size);
+            T[26][step] += ((double) (clock() - crono)) / CLOCKS_PER_SEC;
+            for (i = 0; i < size; i++) { assert(array[i] == sorted[i]); }
+
+            for (i = 0; i < size; i++) { array[i] = random[i]; }
+            crono = clock();
+            block_median_sort_4(array, size);
+            T[27][step] += ((double) (clock() - crono)) / CLOCKS_PER_SEC;
+            for (i = 0; i < size; i++) { assert(array[i] == sorted[i]); }
+
+            for (i = 0; i < size; i++) { array[i] = random[i]; }
+            crono = clock();
+            block_median_sort_5(array, size);
+            T[28][step] += ((double) (clock() - crono)) / CLOCKS_PER_SEC;
+            for (i = 0; i < size; i++) { assert(array[i] == sorted[i]); }
+
+            for (i = 0; i < size; i++) { array[i] = random[i]; }
+            crono = clock();
+            block_median_sort_6(array, size);
+            T[29][step] += ((double) (clock() - crono)) / CLOCKS_PER_SEC;
+            for (i = 0; i < size; i++) { assert(array[i] == sorted[i]); }
+
+            for (i = 0; i < size; i++) { array[i] = random[i]; }
+            crono = clock();
+            block_median_sort_7(array, size);
+            T[30][step] += ((double) (clock() - crono)) / CLOCKS_PER_SEC;
+            for (i = 0; i < size; i++) { assert(array[i] == sorted[i]); }
+
+            for (i = 0; i < size; i++) { array[i] = random[i]; }
+            crono = clock();
+            block_median_sort_8(array, size);
+            T[31][step] += ((double) (clock() - crono)) / CLOCKS_PER_SEC;
+            for (i = 0; i < size; i++) { assert(array[i] == sorted[i]); }
+
+            for (i = 0; i < size; i++) { array[i] = random[i]; }
+            crono = clock();
+            block_median_sort_9(array, size);
+            T[32][step] += ((double) (clock() - crono)) / CLOCKS_PER_SEC;
+            for (i = 0; i < size; i++) { assert(array[i] == sorted[i]); }
+
+            /*** TEST BLOCK QUICK SORT ***************************************/
+
+            for (i = 0; i < size; i++) { array[i] = random[i]; }
+            crono = clock();
+            block_quick_sort_0(array, size);
+            T[33][step] += ((double) (clock() - crono)) / CLOCKS_PER_SEC;
+            for (i = 0; i < size; i++) { assert(array[i] == sorted[i]); }
+
+            for (i = 0; i < size; i++) { array[i] = random[i]; }
+            crono = clock();
+            block_quick_sort_1(array, size);
+            T[34][step] += ((double) (clock() - crono)) / CLOCKS_PER_SEC;
+            for (i = 0; i < size; i++) { assert(array[i] == sorted[i]); }
+
+            for (i = 0; i < size; i++) { array[i] = random[i]; }
+            crono = clock();
+            block_quick_sort_2(array, size);
+            T[35][step] += ((double) (clock() - crono)) / CLOCKS_PER_SEC;
+            for (i = 0; i < size; i++) { assert(array[i] == sorted[i]); }
+
+            for (i = 0; i < size; i++) { array[i] = random[i]; }
+            crono = clock();
+            block_quick_sort_3(array, size);
+            T[36][step] += ((double) (clock() - crono)) / CLOCKS_PER_SEC;
+            for (i = 0; i < size; i++) { assert(array[i] == sorted[i]); }
+
+            for (i = 0; i < size; i++) { array[i] = random[i]; }
+            crono = clock();
+            block_quick_sort_4(array, size);
+            T[37][step] += ((double) (clock() - crono)) / CLOCKS_PER_SEC;
+            for (i = 0; i < size; i++) { assert(array[i] == sorted[i]); }
+
+            for (i = 0; i < size; i++) { array[i] = random[i]; }
+            crono = clock();
+            block_quick_sort_5(array, size);
+            T[38][step] += ((double) (clock() - crono)) / CLOCKS_PER_SEC;
+            for (i = 0; i < size; i++) { assert(array[i] == sorted[i]); }
+
+            for (i = 0; i < size; i++) { array[i] = random[i]; }
+            crono = clock();
+            block_quick_sort_6(array, size);
+            T[39][step] += ((double) (clock() - crono)) / CLOCKS_PER_SEC;
+            for (i = 0; i < size; i++) { assert(array[i] == sorted[i]); }
+
+            for (i = 0; i < size; i++) { array[i] = random[i]; }
+            crono = clock();
+            block_quick_sort_7(array, size);
+            T[40][step] += ((double) (clock() - crono)) / CLOCKS_PER_SEC;
+            for (i = 0; i < size; i++) { assert(array[i] == sorted[i]); }
+
+            for (i = 0; i < size; i++) { array[i] = random[i]; }
+            crono = clock();
+            block_quick_sort_8(array, size);
+            T[41][step] += ((double) (clock() - crono)) / CLOCKS_PER_SEC;
+            for (i = 0; i < size; i++) { assert(array[i] == sorted[i]); }
+
+            for (i = 0; i < size; i++) { array[i] = random[i]; }
+            crono = clock();
+            block_quick_sort_9(array, size);
+            T[42][step] += ((double) (clock() - crono)) / CLOCKS_PER_SEC;
+            for (i = 0; i < size; i++) { assert(array[i] == sorted[i]); }
+
+            /*****************************************************************/
+
+        }
+
+        fprintf(stderr, "\n    heap_sort   vs qsort = %+.2f %%\n", 100.0 * (T[21][step]-T[20][step]) / T[20][step]);
+        fprintf(stderr,   "   shell_sort   vs qsort = %+.2f %%\n", 100.0 * (T[22][step]-T[20][step]) / T[20][step]);
+        fprintf(stderr, "\n  median_sort_0 vs qsort = %+.2f %%\n", 100.0 * (T[ 0][step]-T[20][step]) / T[20][step]);
+        fprintf(stderr,   "   quick_sort_0 vs qsort = %+.2f %%\n", 100.0 * (T[10][step]-T[20][step]) / T[20][step]);
+        fprintf(stderr,   "  block_median_sort_0 vs qsort = %+.2f %%\n", 100.0 * (T[23][step]-T[20][step]) / T[20][step]);
+        fprintf(stderr,   "   block_quick_sort_0 vs qsort = %+.2f %%\n", 100.0 * (T[33][step]-T[20][step]) / T[20][step]);
+        fprintf(stderr, "\n  median_sort_1 vs qsort = %+.2f %%\n", 100.0 * (T[ 1][step]-T[20][step]) / T[20][step]);
+        fprintf(stderr,   "   quick_sort_1 vs qsort = %+.2f %%\n", 100.0 * (T[11][step]-T[20][step]) / T[20][step]);
+        fprintf(stderr,   "  block_median_sort_1 vs qsort = %+.2f %%\n", 100.0 * (T[24][step]-T[20][step]) / T[20][step]);
+        fprintf(stderr,   "   block_quick_sort_1 vs qsort = %+.2f %%\n", 100.0 * (T[34][step]-T[20][step]) / T[20][step]);
+        fprintf(stderr, "\n  median_sort_2 vs qsort = %+.2f %%\n", 100.0 * (T[ 2][step]-T[20][step]) / T[20][step]);
+        fprintf(stderr,   "   quick_sort_2 vs qsort = %+.2f %%\n", 100.0 * (T[12][step]-T[20][step]) / T[20][step]);
+        fprintf(stderr,   "  block_median_sort_2 vs qsort = %+.2f %%\n", 100.0 * (T[25][step]-T[20][step]) / T[20][step]);
+        fprintf(stderr,   "   block_quick_sort_2 vs qsort = %+.2f %%\n", 100.0 * (T[35][step]-T[20][step]) / T[20][step]);
+        fprintf(stderr, "\n  median_sort_3 vs qsort = %+.2f %%\n", 100.0 * (T[ 3][step]-T[20][step]) / T[20][step]);
+        fprintf(stderr,   "   quick_sort_3 vs qsort = %+.2f %%\n", 100.0 * (T[13][step]-T[20][step]) / T[20][step]);
+        fprintf(stderr,   "  block_median_sort_3 vs qsort = %+.2f %%\n", 100.0 * (T[26][step]-T[20][step]) / T[20][step]);
+        fprintf(stderr,   "   block_quick_sort_3 vs qsort = %+.2f %%\n", 100.0 * (T[36][step]-T[20][step]) / T[20][step]);
+        fprintf(stderr, "\n  median_sort_4 vs qsort = %+.2f %%\n", 100.0 * (T[ 4][step]-T[20][step]) / T[20][step]);
+        fprintf(stderr,   "   quick_sort_4 vs qsort = %+.2f %%\n", 100.0 * (T[14][step]-T[20][step]) / T[20][step]);
+        fprintf(stderr,   "  block_median_sort_4 vs qsort = %+.2f %%\n", 100.0 * (T[27][step]-T[20][step]) / T[20][step]);
+        fprintf(stderr,   "   block_quick_sort_4 vs qsort = %+.2f %%\n", 100.0 * (T[37][step]-T[20][step]) / T[20][step]);
+        fprintf(stderr, "\n  median_sort_5 vs qsort = %+.2f %%\n", 100.0 * (T[ 5][step]-T[20][step]) / T[20][step]);
+        fprintf(stderr,   "   quick_sort_5 vs qsort = %+.2f %%\n", 100.0 * (T[15][step]-T[20][step]) / T[20][step]);
+        fprintf(stderr,   "  block_median_sort_5 vs qsort = %+.2f %%\n", 100.0 * (T[28][step]-T[20][step]) / T[20][step]);
+        fprintf(stderr,   "   block_quick_sort_5 vs qsort = %+.2f %%\n", 100.0 * (T[38][step]-T[20][step]) / T[20][step]);
+        fprintf(stderr, "\n  median_sort_6 vs qsort = %+.2f %%\n", 100.0 * (T[ 6][step]-T[20][step]) / T[20][step]);
+        fprintf(stderr,   "   quick_sort_6 vs qsort = %+.2f %%\n", 100.0 * (T[16][step]-T[20][step]) / T[20][step]);
+        fprintf(stderr,   "  block_median_sort_6 vs qsort = %+.2f %%\n", 100.0 * (T[29][step]-T[20][step]) / T[20][step]);
+        fprintf(stderr,   "   block_quick_sort_6 vs qsort = %+.2f %%\n", 100.0 * (T[39][step]-T[20][step]) / T[20][step]);
+        fprintf(stderr, "\n  median_sort_7 vs qsort = %+.2f %%\n", 100.0 * (T[ 7][step]-T[20][step]) / T[20][step]);
+        fprintf(stderr,   "   quick_sort_7 vs qsort = %+.2f %%\n", 100.0 * (T[17][step]-T[20][step]) / T[20][step]);
+        fprintf(stderr,   "  block_median_sort_7 vs qsort = %+.2f %%\n", 100.0 * (T[30][step]-T[20][step]) / T[20][step]);
+        fprintf(stderr,   "   block_quick_sort_7 vs qsort = %+.2f %%\n", 100.0 * (T[40][step]-T[20][step]) / T[20][step]);
+        fprintf(stderr, "\n  median_sort_8 vs qsort = %+.2f %%\n", 100.0 * (T[ 8][step]-T[20][step]) / T[20][step]);
+        fprintf(stderr,   "   quick_sort_8 vs qsort = %+.2f %%\n", 100.0 * (T[18][step]-T[20][step]) / T[20][step]);
+        fprintf(stderr,   "  block_median_sort_8 vs qsort = %+.2f %%\n", 100.0 * (T[31][step]-T[20][step]) / T[20][step]);
+        fprintf(stderr,   "   block_quick_sort_8 vs qsort = %+.2f %%\n", 100.0 * (T[41][step]-T[20][step]) / T[20][step]);
+        fprintf(stderr, "\n  median_sort_9 vs qsort = %+.2f %%\n", 100.0 * (T[ 9][step]-T[20][step]) / T[20][step]);
+        fprintf(stderr,   "   quick_sort_9 vs qsort = %+.2f %%\n", 100.0 * (T[19][step]-T[20][step]) / T[20][step]);
+        fprintf(stderr,   "  block_median_sort_9 vs qsort = %+.2f %%\n", 100.0 * (T[32][step]-T[20][step]) / T[20][step]);
+        fprintf(stderr,   "   block_quick_sort_9 vs qsort = %+.2f %%\n", 100.0 * (T[42][step]-T[20][step]) / T[20][step]);
+    }
+
+    for (step = 0; step < steps; step++) {
+
+        size = S[step];
+        for (k = 0; k < 64; k++) { P[k] = 0.0; }
+
+        fprintf(stderr, "\nSORTING %zu RANDOM INTS IN THE RANGE [0,%zu) IN PARALLEL\n\n", size, size);
+
+        for (j = 0; j < repeat; j++) {
+
+            /*** GENERATE INSTANCE *******************************************/
+
+            for (i = 0; i < size; i++) { random[i] = rand_int(size); }
+            for (i = 0; i < size; i++) { sorted[i] = random[i]; }
+            qsort(sorted, size, sizeof(int), &comp_int);
+
+            /*** TEST PARALLEL MEDIAN SORT ***********************************/
+
+            for (k = 0, threads = 1; threads <= cores; k++, threads <<= 1) {
+                for (i = 0; i < size; i++) { array[i] = random[i]; }
+                start = wall_clock();
+                parallel_median_sort_7(array, size, threads);
+                P[k] += wall_clock() - start;
+                for (i = 0; i < size; i++) { assert(array[i] == sorted[i]); }
+            }
+
+            /*****************************************************************/
+
+        }
+
+        for (k = 0, threads = 1; threads <= cores; k++, threads <<= 1) {
+            fprintf(stderr, "  parallel_median_sort_7 with %2zu threads = x%.2f speedup\n", threads, P[0] / P[k]);
+        }
+    }
+
+    for (step = 0; step < steps; step++) {
+
+        size = S[step];
+        for (k = 0; k < 2; k++) { C[k] = 0.0; }
+
+        fprintf(stderr, "\nSORTING %zu RANDOM INTS IN THE RANGE [0,%zu) BY SUBTREES\n\n", size, size);
+
+        for (j = 0; j < repeat; j++) {
+
+            /*** GENERATE INSTANCE *******************************************/
+
+            for (i = 0; i < size; i++) { random[i] = rand_int(size); }
+            for (i = 0; i < size; i++) { sorted[i] = random[i]; }
+            qsort(sorted, size, sizeof(int), &comp_int);
+
+            /*** TEST BREADTH-FIRST MEDIAN SORT ******************************/
+
+            for (i = 0; i < size; i++) { array[i] = random[i]; }
+            start = wall_clock();
+            cached_median_sort_7(array, size, 0);
+            C[0] += wall_clock() - start;
+            for (i = 0; i < size; i++) { assert(array[i] == sorted[i]); }
+
+            /*** TEST CACHE-BLOCKED MEDIAN SORT ******************************/
+
+            for (i = 0; i < size; i++) { array[i] = random[i]; }
+            start = wall_clock();
+            cached_median_sort_7(array, size, CACHE_SIZE);
+            C[1] += wall_clock() - start;
+            for (i = 0; i < size; i++) { assert(array[i] == sorted[i]); }
+
+            /*****************************************************************/
+
+        }
+
+        fprintf(stderr, "  breadth-first median_sort_7 = %.2f ns per element\n", 1e9 * C[0] / (double) (size * repeat));
+        fprintf(stderr, "  cache-blocked median_sort_7 = %.2f ns per element (%+.2f %%)\n", 1e9 * C[1] / (double) (size * repeat), 100.0 * (C[1]-C[0]) / C[0]);
+    }
+
+    for (step = 0; step < steps; step++) {
+
+        size = S[step];
+        for (k = 0; k < 4; k++) { R[k] = 0.0; }
+
+        fprintf(stderr, "\nSORTING RANKS OF %zu RANDOM INTS IN THE RANGE [0,%zu)\n\n", size, size);
+
+        for (j = 0; j < repeat; j++) {
+
+            /*** GENERATE INSTANCE *******************************************/
+
+            for (i = 0; i < size; i++) { random[i] = rand_int(size); }
+            for (i = 0; i < size; i++) { sorted[i] = random[i]; }
+            qsort(sorted, size, sizeof(int), &comp_int);
+
+            /*** TEST PARTIAL SORT (TOP 1000) ********************************/
+
+            for (i = 0; i < size; i++) { array[i] = random[i]; }
+            crono = clock();
+            median_partial_sort_7(array, size, 0, 1000);
+            R[0] += ((double) (clock() - crono)) / CLOCKS_PER_SEC;
+            for (i = 0; i < 1000; i++) { assert(array[i] == sorted[i]); }
+
+            /*** TEST PARTIAL SORT (MIDDLE 50%) ******************************/
+
+            for (i = 0; i < size; i++) { array[i] = random[i]; }
+            crono = clock();
+            median_partial_sort_7(array, size, size/4, size - size/4);
+            R[1] += ((double) (clock() - crono)) / CLOCKS_PER_SEC;
+            for (i = size/4; i < size - size/4; i++) { assert(array[i] == sorted[i]); }
+
+            /*** TEST MEDIAN SORT ********************************************/
+
+            for (i = 0; i < size; i++) { array[i] = random[i]; }
+            crono = clock();
+            median_sort_7(array, size);
+            R[2] += ((double) (clock() - crono)) / CLOCKS_PER_SEC;
+            for (i = 0; i < size; i++) { assert(array[i] == sorted[i]); }
+
+            /*** TEST QSORT **************************************************/
+
+            for (i = 0; i < size; i++) { array[i] = random[i]; }
+            crono = clock();
+            qsort(array, size, sizeof(int), &comp_int);
+            R[3] += ((double) (clock() - crono)) / CLOCKS_PER_SEC;
+            for (i = 0; i < size; i++) { assert(array[i] == sorted[i]); }
+
+            /*****************************************************************/
+
+        }
+
+        fprintf(stderr, "  median_partial_sort_7 top 1000 vs qsort = %+.2f %%\n", 100.0 * (R[0]-R[3]) / R[3]);
+        fprintf(stderr, "  median_partial_sort_7 mid 50%%  vs qsort = %+.2f %%\n", 100.0 * (R[1]-R[3]) / R[3]);
+        fprintf(stderr, "  median_sort_7                 vs qsort = %+.2f %%\n", 100.0 * (R[2]-R[3]) / R[3]);
+    }
+
+    for (step = 0; step < steps; step++) {
+
+        size = S[step];
+        for (k = 0; k < 3; k++) { Q[k] = 0.0; }
+        touches = 0;
+
+        fprintf(stderr, "\nSELECTING p50, p90, p99 AND p99.9 OF %zu RANDOM DOUBLES\n\n", size);
+
+        for (j = 0; j < repeat; j++) {
+
+            /*** GENERATE INSTANCE *******************************************/
+
+            for (i = 0; i < size; i++) { random[i] = rand_int(size); }
+            for (i = 0; i < size; i++) { sorted[i] = random[i]; }
+            qsort(sorted, size, sizeof(int), &comp_int);
+
+            /*** TEST MEDIAN QUANTILES ***************************************/
+
+            quantiles[0] = size *  500 / 1000;
+            quantiles[1] = size *  900 / 1000;
+            quantiles[2] = size *  990 / 1000;
+            quantiles[3] = size *  999 / 1000;
+            for (i = 0; i < size; i++) { f64[i] = (double) random[i]; }
+            crono = clock();
+            median_quantiles_f64(f64, size, quantiles, 4);
+            Q[0] += ((double) (clock() - crono)) / CLOCKS_PER_SEC;
+            for (k = 0; k < 4; k++) { assert(f64[quantiles[k]] == (double) sorted[quantiles[k]]); }
+
+            for (i = 0; i < size; i++) { f64[i] = (double) random[i]; }
+            crono = clock();
+            touches += median_quantiles_f64_generic(f64, size, quantiles, 4);
+            Q[1] += ((double) (clock() - crono)) / CLOCKS_PER_SEC;
+            for (k = 0; k < 4; k++) { assert(f64[quantiles[k]] == (double) sorted[quantiles[k]]); }
+
+            /*** TEST INDEPENDENT SELECTIONS *********************************/
+
+            for (i = 0; i < size; i++) { f64[i] = (double) random[i]; }
+            crono = clock();
+            for (k = 0; k < 4; k++) { median_nth_element_f64_generic(f64, size, quantiles[k]); }
+            Q[2] += ((double) (clock() - crono)) / CLOCKS_PER_SEC;
+            for (k = 0; k < 4; k++) { assert(f64[quantiles[k]] == (double) sorted[quantiles[k]]); }
+
+            /*****************************************************************/
+
+        }
+
+        fprintf(stderr, "  median_quantiles_f64         vs 4 selections = %+.2f %%\n", 100.0 * (Q[0]-Q[2]) / Q[2]);
+        fprintf(stderr, "  median_quantiles_f64_generic vs 4 selections = %+.2f %%\n", 100.0 * (Q[1]-Q[2]) / Q[2]);
+        fprintf(stderr, "  median_quantiles_f64_generic touches %.2f x length (vs 4.00 x length for 4 selections)\n", (double) touches / (double) (size * repeat));
+    }
+
+    for (step = 0; step < steps; step++) {
+
+        size = S[step];
+        for (k = 0; k < 3; k++) { U[k] = 0.0; }
+
+        fprintf(stderr, "\nSORTING %zu RANDOM INTS IN THE RANGE [0,%zu) IN SLICES\n\n", size, size);
+
+        for (j = 0; j < repeat; j++) {
+
+            /*** GENERATE INSTANCE *******************************************/
+
+            for (i = 0; i < size; i++) { random[i] = rand_int(size); }
+            for (i = 0; i < size; i++) { sorted[i] = random[i]; }
+            qsort(sorted, size, sizeof(int), &comp_int);
+
+            /*** TEST MEDIAN SORT ********************************************/
+
+            for (i = 0; i < size; i++) { array[i] = random[i]; }
+            start = wall_clock();
+            median_sort_7(array, size);
+            U[0] += wall_clock() - start;
+            for (i = 0; i < size; i++) { assert(array[i] == sorted[i]); }
+
+            /*** TEST RESUMABLE MEDIAN SORT **********************************/
+
+            for (i = 0; i < size; i++) { array[i] = random[i]; }
+            median_sort_begin_7(&state, array, size);
+            while (!median_sort_done_7(&state)) {
+                k     = median_sort_ready_7(&state);
+                start = wall_clock();
+                median_sort_step_7(&state, 1 << 16);
+                slice = wall_clock() - start;
+                U[1] += slice;
+                U[2]  = slice > U[2] ? slice : U[2];
+                for (i = k; i < median_sort_ready_7(&state); i++) { assert(array[i] == sorted[i]); }
+
+                /* Beyond the prefix, only ranks (multiples of 2^7) can be final */
+                for (i = 0; j == 0 && i < size; i += 1 << 7) {
+                    assert(!median_sort_is_final_7(&state, i) || array[i] == sorted[i]);
+                }
+            }
+            for (i = 0; i < size; i++) { assert(array[i] == sorted[i]); }
+
+            /*****************************************************************/
+
+        }
+
+        fprintf(stderr, "  median_sort_7 in slices of 65536 elements = %+.2f %% (longest slice %.3f ms)\n", 100.0 * (U[1]-U[0]) / U[0], 1e3 * U[2]);
+    }
+
+    for (step = 0; step < steps; step++) {
+
+        size = S[step];
+        for (k = 0; k < 6; k++) { F[k] = 0.0; }
+
+        fprintf(stderr, "\nSORTING %zu RANDOM INTS WITH FEW DISTINCT VALUES\n\n", size);
+
+        for (j = 0; j < repeat; j++) {
+
+            /*** GENERATE INSTANCE (16 DISTINCT VALUES) *********************/
+
+            for (i = 0; i < size; i++) { random[i] = rand_int(16); }
+            for (i = 0; i < size; i++) { sorted[i] = random[i]; }
+            qsort(sorted, size, sizeof(int), &comp_int);
+
+            /*** TEST MEDIAN SORT ********************************************/
+
+            for (i = 0; i < size; i++) { array[i] = random[i]; }
+            crono = clock();
+            median_sort_7(array, size);
+            F[0] += ((double) (clock() - crono)) / CLOCKS_PER_SEC;
+            for (i = 0; i < size; i++) { assert(array[i] == sorted[i]); }
+
+            /*** TEST FAT MEDIAN SORT ****************************************/
+
+            for (i = 0; i < size; i++) { array[i] = random[i]; }
+            crono = clock();
+            fat_median_sort_7(array, size);
+            F[1] += ((double) (clock() - crono)) / CLOCKS_PER_SEC;
+            for (i = 0; i < size; i++) { assert(array[i] == sorted[i]); }
+
+            /*** TEST QSORT **************************************************/
+
+            for (i = 0; i < size; i++) { array[i] = random[i]; }
+            crono = clock();
+            qsort(array, size, sizeof(int), &comp_int);
+            F[2] += ((double) (clock() - crono)) / CLOCKS_PER_SEC;
+            for (i = 0; i < size; i++) { assert(array[i] == sorted[i]); }
+
+            /*** GENERATE INSTANCE (256 DISTINCT VALUES) ********************/
+
+            for (i = 0; i < size; i++) { random[i] = rand_int(256); }
+            for (i = 0; i < size; i++) { sorted[i] = random[i]; }
+            qsort(sorted, size, sizeof(int), &comp_int);
+
+            /*** TEST MEDIAN SORT ********************************************/
+
+            for (i = 0; i < size; i++) { array[i] = random[i]; }
+            crono = clock();
+            median_sort_7(array, size);
+            F[3] += ((double) (clock() - crono)) / CLOCKS_PER_SEC;
+            for (i = 0; i < size; i++) { assert(array[i] == sorted[i]); }
+
+            /*** TEST FAT MEDIAN SORT ****************************************/
+
+            for (i = 0; i < size; i++) { array[i] = random[i]; }
+            crono = clock();
+            fat_median_sort_7(array, size);
+            F[4] += ((double) (clock() - crono)) / CLOCKS_PER_SEC;
+            for (i = 0; i < size; i++) { assert(array[i] == sorted[i]); }
+
+            /*** TEST QSORT **************************************************/
+
+            for (i = 0; i < size; i++) { array[i] = random[i]; }
+            crono = clock();
+            qsort(array, size, sizeof(int), &comp_int);
+            F[5] += ((double) (clock() - crono)) / CLOCKS_PER_SEC;
+            for (i = 0; i < size; i++) { assert(array[i] == sorted[i]); }
+
+            /*****************************************************************/
+
+        }
+
+        fprintf(stderr, "      median_sort_7 (16 values) vs qsort = %+.2f %%\n", 100.0 * (F[0]-F[2]) / F[2]);
+        fprintf(stderr, "  fat_median_sort_7 (16 values) vs qsort = %+.2f %%\n", 100.0 * (F[1]-F[2]) / F[2]);
+        fprintf(stderr, "     median_sort_7 (256 values) vs qsort = %+.2f %%\n", 100.0 * (F[3]-F[5]) / F[5]);
+        fprintf(stderr, " fat_median_sort_7 (256 values) vs qsort = %+.2f %%\n", 100.0 * (F[4]-F[5]) / F[5]);
+    }
+
+    for (step = 0; step < steps; step++) {
+
+        size = S[step];
+        for (k = 0; k < 6; k++) { Z[k][0] = Z[k][1] = Z[k][2] = 0.0; }
+
+        fprintf(stderr, "\nSORTING %zu NEARLY SORTED INTS\n\n", size);
+
+        for (j = 0; j < repeat; j++) {
+            for (k = 0; k < 6; k++) {
+
+                /*** GENERATE INSTANCE (SORTED, PERTURBED OR REVERSED) *******/
+
+                for (i = 0; i < size; i++) { sorted[i] = (int) i; }
+                if (perturbed[k] < 0.0) {
+                    for (i = 0; i < size; i++) { random[i] = (int) (size-1-i); }
+                } else {
+                    for (i = 0; i < size; i++) { random[i] = (int) i; }
+                    for (i = 0; i < (size_t) (perturbed[k] * size / 2); i++) {
+                        int x = rand_int(size), y = rand_int(size), t = random[x];
+                        random[x] = random[y]; random[y] = t;
+                    }
+                }
+
+                /*** TEST ADAPTIVE MEDIAN SORT *******************************/
+
+                for (i = 0; i < size; i++) { array[i] = random[i]; }
+                crono = clock();
+                adaptive_median_sort_7(array, size);
+                Z[k][0] += ((double) (clock() - crono)) / CLOCKS_PER_SEC;
+                for (i = 0; i < size; i++) { assert(array[i] == sorted[i]); }
+
+                /*** TEST MEDIAN SORT ****************************************/
+
+                for (i = 0; i < size; i++) { array[i] = random[i]; }
+                crono = clock();
+                median_sort_7(array, size);
+                Z[k][1] += ((double) (clock() - crono)) / CLOCKS_PER_SEC;
+                for (i = 0; i < size; i++) { assert(array[i] == sorted[i]); }
+
+                /*** TEST QSORT **********************************************/
+
+                for (i = 0; i < size; i++) { array[i] = random[i]; }
+                crono = clock();
+                qsort(array, size, sizeof(int), &comp_int);
+                Z[k][2] += ((double) (clock() - crono)) / CLOCKS_PER_SEC;
+                for (i = 0; i < size; i++) { assert(array[i] == sorted[i]); }
+
+                /*************************************************************/
+            }
+        }
+
+        for (k = 0; k < 6; k++) {
+            if (perturbed[k] < 0.0) {
+                fprintf(stderr, "  adaptive_median_sort_7 (reversed)       vs median_sort_7 = %+.2f %%, vs qsort = %+.2f %%\n",
+                        100.0 * (Z[k][0]-Z[k][1]) / Z[k][1], 100.0 * (Z[k][0]-Z[k][2]) / Z[k][2]);
+            } else {
+                fprintf(stderr, "  adaptive_median_sort_7 (%5.1f %% moved)  vs median_sort_7 = %+.2f %%, vs qsort = %+.2f %%\n",
+                        100.0 * perturbed[k], 100.0 * (Z[k][0]-Z[k][1]) / Z[k][1], 100.0 * (Z[k][0]-Z[k][2]) / Z[k][2]);
+            }
+        }
+    }
+
+    for (step = 0; step < steps; step++) {
+
+        size = S[step];
+        for (k = 0; k < 4; k++) { B[k][0] = B[k][1] = B[k][2] = B[k][3] = 0.0; }
+
+        fprintf(stderr, "\nSORTING ROWS OF %zu RANDOM INTS IN THE RANGE [0,%zu)\n\n", size, size);
+
+        batch   = (int **)  malloc(size * sizeof(int *));   assert(batch);
+        lengths = (size_t *) malloc(size * sizeof(size_t));  assert(lengths);
+
+        for (j = 0; j < repeat; j++) {
+            for (k = 0; k < 4; k++) {
+
+                /*** GENERATE INSTANCE (size / widths[k] ROWS) ***************/
+
+                count = size / widths[k];
+                for (i = 0; i < size; i++) { random[i] = rand_int(size); }
+                for (i = 0; i < size; i++) { sorted[i] = random[i]; }
+                for (i = 0; i < count; i++) {
+                    qsort(sorted + i*widths[k], widths[k], sizeof(int), &comp_int);
+                    batch[i]   = array + i*widths[k];
+                    lengths[i] = widths[k];
+                }
+
+                /*** TEST A LOOP OF MEDIAN SORT ******************************/
+
+                for (i = 0; i < size; i++) { array[i] = random[i]; }
+                start = wall_clock();
+                for (i = 0; i < count; i++) { median_sort_7(array + i*widths[k], widths[k]); }
+                B[k][0] += wall_clock() - start;
+                for (i = 0; i < count*widths[k]; i++) { assert(array[i] == sorted[i]); }
+
+                /*** TEST MEDIAN SORT BATCH **********************************/
+
+                for (i = 0; i < size; i++) { array[i] = random[i]; }
+                start = wall_clock();
+                median_sort_batch_7(batch, lengths, count);
+                B[k][1] += wall_clock() - start;
+                for (i = 0; i < count*widths[k]; i++) { assert(array[i] == sorted[i]); }
+
+                /*** TEST MEDIAN SORT ROWS ***********************************/
+
+                for (i = 0; i < size; i++) { array[i] = random[i]; }
+                start = wall_clock();
+                median_sort_rows_7(array, count, widths[k], widths[k]);
+                B[k][2] += wall_clock() - start;
+                for (i = 0; i < count*widths[k]; i++) { assert(array[i] == sorted[i]); }
 
-/** AUXILIARY FUNCTIONS *************************************************** **/
+                /*** TEST PARALLEL MEDIAN SORT ROWS **************************/
 
-int comp_int(const void *i, const void *j) {
-    int ii = *(int *) i;
-    int jj = *(int *) j;
-    return (((ii) > (jj)) - ((ii) < (jj)));
-}
+                for (i = 0; i < size; i++) { array[i] = random[i]; }
+                start = wall_clock();
+                parallel_median_sort_rows_7(array, count, widths[k], widths[k], cores);
+                B[k][3] += wall_clock() - start;
+                for (i = 0; i < count*widths[k]; i++) { assert(array[i] == sorted[i]); }
 
-int rand_int(const int n) {
+                /*************************************************************/
+            }
+        }
 
-    /* Preconditions */
-    assert(n > 0);
-    assert(RAND_MAX >= n);
+        free(batch);
+        free(lengths);
 
-    /* Monte-Carlo uniformly random generator */
-    int r, range = RAND_MAX - (RAND_MAX % n);
-    do { r = rand(); } while (r >= range);
-    return r % n;
-}
+        for (k = 0; k < 4; k++) {
+            count = repeat * (size / widths[k]);
+            if (count == 0) { continue; }
+            fprintf(stderr, "  %3zu ints per row: median_sort_7 loop = %.2f Mrows/s, median_sort_batch_7 = %.2f Mrows/s, "
+                    "median_sort_rows_7 = %.2f Mrows/s, parallel_median_sort_rows_7 (%zu threads) = %.2f Mrows/s\n",
+                    widths[k], 1e-6 * count / B[k][0], 1e-6 * count / B[k][1], 1e-6 * count / B[k][2], cores, 1e-6 * count / B[k][3]);
+        }
+    }
 
-IMPORT_MEDIAN_SORT(int, LESS_THAN, 0, , _0)
-IMPORT_MEDIAN_SORT(int, LESS_THAN, 1, , _1)
-IMPORT_MEDIAN_SORT(int, LESS_THAN, 2, , _2)
-IMPORT_MEDIAN_SORT(int, LESS_THAN, 3, , _3)
-IMPORT_MEDIAN_SORT(int, LESS_THAN, 4, , _4)
-IMPORT_MEDIAN_SORT(int, LESS_THAN, 5, , _5)
-IMPORT_MEDIAN_SORT(int, LESS_THAN, 6, , _6)
-IMPORT_MEDIAN_SORT(int, LESS_THAN, 7, , _7)
-IMPORT_MEDIAN_SORT(int, LESS_THAN, 8, , _8)
-IMPORT_MEDIAN_SORT(int, LESS_THAN, 9, , _9)
-
-IMPORT_QUICK_SORT(int, LESS_THAN, 0, , _0)
-IMPORT_QUICK_SORT(int, LESS_THAN, 1, , _1)
-IMPORT_QUICK_SORT(int, LESS_THAN, 2, , _2)
-IMPORT_QUICK_SORT(int, LESS_THAN, 3, , _3)
-IMPORT_QUICK_SORT(int, LESS_THAN, 4, , _4)
-IMPORT_QUICK_SORT(int, LESS_THAN, 5, , _5)
-IMPORT_QUICK_SORT(int, LESS_THAN, 6, , _6)
-IMPORT_QUICK_SORT(int, LESS_THAN, 7, , _7)
-IMPORT_QUICK_SORT(int, LESS_THAN, 8, , _8)
-IMPORT_QUICK_SORT(int, LESS_THAN, 9, , _9)
+    for (step = 0; step < steps-1; step++) {
 
-IMPORT_HEAP_SORT(int, LESS_THAN, , )
+        size = S[step];
+        for (k = 0; k < 8; k++) { G[k] = 0.0; }
 
-IMPORT_SHELL_SORT(int, LESS_THAN, , )
+        fprintf(stderr, "\nSORTING %zu RANDOM RECORDS WITH median_sort_generic\n\n", size);
 
-/** MAIN ****************************************************************** **/
+        for (j = 0; j < repeat; j++) {
 
-int main (void) {
+            /*** GENERATE INSTANCE *******************************************/
 
-    clock_t crono;
-    size_t i, j, step, size;
+            for (i = 0; i < size; i++) { random[i] = rand_int(size); }
+            for (i = 0; i < size; i++) { sorted[i] = random[i]; }
+            qsort(sorted, size, sizeof(int), &comp_int);
 
-    const size_t repeat = 100;
-    const size_t steps  = 6;
+            for (k = 0; k < 4; k++) {
 
-    double T[23][steps];
-    size_t S[steps];
-    for (step = 1, S[0] = 1000; step < steps; S[step] = S[step-1]*10, step++);
+                /*** TEST MEDIAN SORT GENERIC ********************************/
 
-    int *buffer = (int *) malloc(S[steps-1] * sizeof(int));  assert(buffer);
-    int *random = (int *) malloc(S[steps-1] * sizeof(int));  assert(random);
-    int *sorted = (int *) malloc(S[steps-1] * sizeof(int));  assert(sorted);
-    int *array  = (int *) malloc(S[steps-1] * sizeof(int));  assert(array);
+                memset(records, 0, size * record[k]);
+                for (i = 0; i < size; i++) {
+                    memcpy(records + i*record[k], &random[i], sizeof(int));
+                }
+                crono = clock();
+                median_sort_generic(records, size, record[k], &comp_int_r, NULL);
+                G[2*k] += ((double) (clock() - crono)) / CLOCKS_PER_SEC;
+                for (i = 0; i < size; i++) {
+                    assert(!memcmp(records + i*record[k], &sorted[i], sizeof(int)));
+                }
 
-    for (step = 0, size = 10; step < steps; step++) {
+                /*** TEST QSORT **********************************************/
+
+                memset(records, 0, size * record[k]);
+                for (i = 0; i < size; i++) {
+                    memcpy(records + i*record[k], &random[i], sizeof(int));
+                }
+                crono = clock();
+                qsort(records, size, record[k], &comp_int);
+                G[2*k+1] += ((double) (clock() - crono)) / CLOCKS_PER_SEC;
+            }
+
+            /*****************************************************************/
+
+        }
+
+        for (k = 0; k < 4; k++) {
+            fprintf(stderr, "  median_sort_generic (%2zu bytes) vs qsort = %+.2f %%\n", record[k], 100.0 * (G[2*k]-G[2*k+1]) / G[2*k+1]);
+        }
+    }
+
+    /*** CALIBRATE MEDIAN SORT AUTO (AND CHECK THAT THE TABLE ROUND-TRIPS) ***/
+
+    for (i = 0; i < S[steps-3]; i++) { random[i] = rand_int(S[steps-3]); }
+    start = wall_clock();
+    median_sort_calibrate(random, S[steps-3]);
+    fprintf(stderr, "\nCALIBRATING median_sort_auto TOOK %.2f s\n", wall_clock() - start);
+    failed  = median_tuning_save("MedianSort.tuning");
+    failed |= median_tuning_load("MedianSort.tuning");
+    assert(!failed);
+    remove("MedianSort.tuning");
+
+    for (step = 0; step < steps; step++) {
 
         size = S[step];
-        for (i = 0; i < 23; i++) { T[i][step] = 0.0; }
+        for (k = 0; k < 3; k++) { X[k] = 0.0; }
 
-        fprintf(stderr, "\nSORTING %zu RANDOM INTS IN THE RANGE [0,%zu)\n", size, size);
+        fprintf(stderr, "\nSORTING %zu RANDOM INTS IN THE RANGE [0,%zu) WITH A TUNED POWER\n\n", size, size);
 
         for (j = 0; j < repeat; j++) {
 
             /*** GENERATE INSTANCE *******************************************/
 
             for (i = 0; i < size; i++) { random[i] = rand_int(size); }
-
-            /*** TEST QSORT **************************************************/
-
             for (i = 0; i < size; i++) { sorted[i] = random[i]; }
-            crono = clock();
             qsort(sorted, size, sizeof(int), &comp_int);
-            T[20][step] += ((double) (clock() - crono)) / CLOCKS_PER_SEC;
-            for (i = 1; i < size; i++) { assert(sorted[i-1] <= sorted[i]); }
 
-            /*** TEST HEAP SORT **********************************************/
+            /*** TEST MEDIAN SORT AUTO ***************************************/
 
             for (i = 0; i < size; i++) { array[i] = random[i]; }
             crono = clock();
-            heap_sort(array, size);
-            T[21][step] += ((double) (clock() - crono)) / CLOCKS_PER_SEC;
+            median_sort_auto(array, size);
+            X[0] += ((double) (clock() - crono)) / CLOCKS_PER_SEC;
             for (i = 0; i < size; i++) { assert(array[i] == sorted[i]); }
 
-            /*** TEST SHELL SORT *********************************************/
+            /*** TEST MEDIAN SORT ********************************************/
 
             for (i = 0; i < size; i++) { array[i] = random[i]; }
             crono = clock();
-            shell_sort(array, size);
-            T[22][step] += ((double) (clock() - crono)) / CLOCKS_PER_SEC;
-            for (i = 0; i < size; i++) { assert(array[i] == sorted[i]); }
+            median_sort_7(array, size);
+            X[1] += ((double) (clock() - crono)) / CLOCKS_PER_SEC;
 
-            /*** TEST MEDIAN SORT ********************************************/
+            /*** TEST QSORT **************************************************/
 
             for (i = 0; i < size; i++) { array[i] = random[i]; }
             crono = clock();
-            median_sort_0(array, size);
-            T[0][step] += ((double) (clock() - crono)) / CLOCKS_PER_SEC;
-            for (i = 0; i < size; i++) { assert(array[i] == sorted[i]); }
+            qsort(array, size, sizeof(int), &comp_int);
+            X[2] += ((double) (clock() - crono)) / CLOCKS_PER_SEC;
 
-            for (i = 0; i < size; i++) { array[i] = random[i]; }
-            crono = clock();
-            median_sort_1(array, size);
-            T[1][step] += ((double) (clock() - crono)) / CLOCKS_PER_SEC;
-            for (i = 0; i < size; i++) { assert(array[i] == sorted[i]); }
+            /*****************************************************************/
 
-            for (i = 0; i < size; i++) { array[i] = random[i]; }
-            crono = clock();
-            median_sort_2(array, size);
-            T[2][step] += ((double) (clock() - crono)) / CLOCKS_PER_SEC;
-            for (i = 0; i < size; i++) { assert(array[i] == sorted[i]); }
+        }
 
-            for (i = 0; i < size; i++) { array[i] = random[i]; }
-            crono = clock();
-            median_sort_3(array, size);
-            T[3][step] += ((double) (clock() - crono)) / CLOCKS_PER_SEC;
-            for (i = 0; i < size; i++) { assert(array[i] == sorted[i]); }
+        fprintf(stderr, "  median_sort_auto (%s) vs median_sort_7 = %+.2f %%\n", median_auto_config(size), 100.0 * (X[0]-X[1]) / X[1]);
+        fprintf(stderr, "  median_sort_auto (%s) vs qsort         = %+.2f %%\n", median_auto_config(size), 100.0 * (X[0]-X[2]) / X[2]);
+    }
 
-            for (i = 0; i < size; i++) { array[i] = random[i]; }
-            crono = clock();
-            median_sort_4(array, size);
-            T[4][step] += ((double) (clock() - crono)) / CLOCKS_PER_SEC;
-            for (i = 0; i < size; i++) { assert(array[i] == sorted[i]); }
+    for (step = 0; step < steps-2; step++) {
 
-            for (i = 0; i < size; i++) { array[i] = random[i]; }
+        size = S[step];
+        for (k = 0; k < 5; k++) { H[k] = 0.0; }
+
+        fprintf(stderr, "\nSORTING %zu RANDOM RECORDS OF 64 AND 256 BYTES BY KEY\n\n", size);
+
+        r64   = (record_64  *) malloc(size * sizeof(record_64));  assert(r64);
+        r256  = (record_256 *) malloc(size * sizeof(record_256)); assert(r256);
+        bytes = (unsigned char *) malloc(size * 252);             assert(bytes);
+        index = (size_t *) malloc(size * sizeof(size_t));         assert(index);
+        payload = bytes;
+
+        for (j = 0; j < repeat; j++) {
+
+            /*** GENERATE INSTANCE *******************************************/
+
+            for (i = 0; i < size; i++) { random[i] = rand_int(size); }
+            for (i = 0; i < size; i++) { sorted[i] = random[i]; }
+            qsort(sorted, size, sizeof(int), &comp_int);
+
+            /*** TEST MEDIAN SORT (RECORDS) **********************************/
+
+            for (i = 0; i < size; i++) {
+                r64[i].key = random[i];
+                memset(r64[i].payload, random[i] & 0xFF, 60);
+            }
             crono = clock();
-            median_sort_5(array, size);
-            T[5][step] += ((double) (clock() - crono)) / CLOCKS_PER_SEC;
+            record_median_sort_64(r64, size);
+            H[0] += ((double) (clock() - crono)) / CLOCKS_PER_SEC;
+            for (i = 0; i < size; i++) { assert(r64[i].key == sorted[i]); }
+            for (i = 0; i < size; i++) { assert(r64[i].payload[59] == (sorted[i] & 0xFF)); }
+
+            for (i = 0; i < size; i++) {
+                r256[i].key = random[i];
+                memset(r256[i].payload, random[i] & 0xFF, 252);
+            }
+            crono = clock();
+            record_median_sort_256(r256, size);
+            H[3] += ((double) (clock() - crono)) / CLOCKS_PER_SEC;
+            for (i = 0; i < size; i++) { assert(r256[i].key == sorted[i]); }
+            for (i = 0; i < size; i++) { assert(r256[i].payload[251] == (sorted[i] & 0xFF)); }
+
+            /*** TEST MEDIAN SORT KV (KEYS AND PAYLOADS) *********************/
+
+            width = 60;
+            for (i = 0; i < size; i++) {
+                array[i] = random[i];
+                memset(bytes + i*width, random[i] & 0xFF, width);
+            }
+            crono = clock();
+            failed = median_sort_kv_5(array, size, &payload, &width, 1);
+            H[1] += ((double) (clock() - crono)) / CLOCKS_PER_SEC;
+            assert(!failed);
             for (i = 0; i < size; i++) { assert(array[i] == sorted[i]); }
+            for (i = 0; i < size; i++) { assert(bytes[i*width+width-1] == (sorted[i] & 0xFF)); }
 
-            for (i = 0; i < size; i++) { array[i] = random[i]; }
+            width = 252;
+            for (i = 0; i < size; i++) {
+                array[i] = random[i];
+                memset(bytes + i*width, random[i] & 0xFF, width);
+            }
             crono = clock();
-            median_sort_6(array, size);
-            T[6][step] += ((double) (clock() - crono)) / CLOCKS_PER_SEC;
+            failed = median_sort_kv_5(array, size, &payload, &width, 1);
+            H[4] += ((double) (clock() - crono)) / CLOCKS_PER_SEC;
+            assert(!failed);
             for (i = 0; i < size; i++) { assert(array[i] == sorted[i]); }
+            for (i = 0; i < size; i++) { assert(bytes[i*width+width-1] == (sorted[i] & 0xFF)); }
+
+            /*** TEST MEDIAN ARGSORT (KEYS ONLY) *****************************/
 
-            for (i = 0; i < size; i++) { array[i] = random[i]; }
             crono = clock();
-            median_sort_7(array, size);
-            T[7][step] += ((double) (clock() - crono)) / CLOCKS_PER_SEC;
-            for (i = 0; i < size; i++) { assert(array[i] == sorted[i]); }
+            failed = median_argsort_5(random, size, index);
+            H[2] += ((double) (clock() - crono)) / CLOCKS_PER_SEC;
+            assert(!failed);
+            for (i = 0; i < size; i++) { assert(random[index[i]] == sorted[i]); }
 
-            for (i = 0; i < size; i++) { array[i] = random[i]; }
+            /*****************************************************************/
+
+        }
+
+        fprintf(stderr, "  median_sort_kv_5 ( 64 bytes) vs record_median_sort_64  = %+.2f %%\n", 100.0 * (H[1]-H[0]) / H[0]);
+        fprintf(stderr, "  median_argsort_5 ( 64 bytes) vs record_median_sort_64  = %+.2f %%\n", 100.0 * (H[2]-H[0]) / H[0]);
+        fprintf(stderr, "  median_sort_kv_5 (256 bytes) vs record_median_sort_256 = %+.2f %%\n", 100.0 * (H[4]-H[3]) / H[3]);
+        fprintf(stderr, "  median_argsort_5 (256 bytes) vs record_median_sort_256 = %+.2f %%\n", 100.0 * (H[2]-H[3]) / H[3]);
+
+        free(r64);
+        free(r256);
+        free(bytes);
+        free(index);
+    }
+
+    for (step = 3; step < steps && step < 4; step++) {
+
+        size = S[step];
+        for (k = 0; k < 3; k++) { Y[k] = 0.0; }
+
+        fprintf(stderr, "\nSORTING A FILE OF %zu RANDOM RECORDS OF 64 BYTES BY KEY\n\n", size);
+
+        r64 = (record_64 *) malloc(size * sizeof(record_64));  assert(r64);
+
+        for (j = 0; j < repeat / 10; j++) {
+
+            /*** GENERATE INSTANCE *******************************************/
+
+            for (i = 0; i < size; i++) { random[i] = rand_int(size); }
+            for (i = 0; i < size; i++) { sorted[i] = random[i]; }
+            qsort(sorted, size, sizeof(int), &comp_int);
+
+            /*** TEST MEDIAN SORT FILE (IN MEMORY AND OUT OF CORE) ***********/
+
+            for (k = 0; k < 2; k++) {
+                for (i = 0; i < size; i++) {
+                    r64[i].key = random[i];
+                    memset(r64[i].payload, random[i] & 0xFF, 60);
+                }
+                file  = fopen("MedianSort.records", "wb");  assert(file);
+                moved = fwrite(r64, sizeof(record_64), size, file);
+                fclose(file);
+                assert(moved == size);
+
+                start = wall_clock();
+                if (k == 0) {
+                    failed = median_sort_file_5("MedianSort.records", sizeof(record_64),
+                                                offsetof(record_64, key));
+                } else {
+                    failed = median_sort_file_budget_5("MedianSort.records", sizeof(record_64),
+                                                       offsetof(record_64, key),
+                                                       size * sizeof(record_64) / 16);
+                }
+                Y[k] += wall_clock() - start;
+                assert(!failed);
+                (void) failed;
+
+                file  = fopen("MedianSort.records", "rb");  assert(file);
+                moved = fread(r64, sizeof(record_64), size, file);
+                fclose(file);
+                assert(moved == size);
+                for (i = 0; i < size; i++) { assert(r64[i].key == sorted[i]); }
+                for (i = 0; i < size; i++) { assert(r64[i].payload[59] == (sorted[i] & 0xFF)); }
+            }
+
+            /*** TEST READ, MEDIAN SORT AND WRITE ****************************/
+
+            for (i = 0; i < size; i++) {
+                r64[i].key = random[i];
+                memset(r64[i].payload, random[i] & 0xFF, 60);
+            }
+            file  = fopen("MedianSort.records", "wb");  assert(file);
+            moved = fwrite(r64, sizeof(record_64), size, file);
+            fclose(file);
+            assert(moved == size);
+
+            start = wall_clock();
+            file  = fopen("MedianSort.records", "r+b");  assert(file);
+            moved = fread(r64, sizeof(record_64), size, file);
+            record_median_sort_64(r64, size);
+            rewind(file);
+            moved += fwrite(r64, sizeof(record_64), size, file);
+            fclose(file);
+            Y[2] += wall_clock() - start;
+            assert(moved == 2 * size);
+
+            /*****************************************************************/
+
+        }
+        remove("MedianSort.records");
+
+        fprintf(stderr, "  median_sort_file_5 (in memory)   vs read + record_median_sort_64 + write = %+.2f %%\n", 100.0 * (Y[0]-Y[2]) / Y[2]);
+        fprintf(stderr, "  median_sort_file_5 (1/16 memory) vs read + record_median_sort_64 + write = %+.2f %%\n", 100.0 * (Y[1]-Y[2]) / Y[2]);
+
+        free(r64);
+    }
+
+    for (step = 0; step < steps; step++) {
+
+        size = S[step];
+        for (k = 0; k < 8; k++) { V[k] = 0.0; }
+
+        fprintf(stderr, "\nSORTING %zu RANDOM KEYS IN THE RANGE [0,%zu) WITH SIMD PARTITIONS\n\n", size, size);
+
+        for (j = 0; j < repeat; j++) {
+
+            /*** GENERATE INSTANCE *******************************************/
+
+            for (i = 0; i < size; i++) { random[i] = rand_int(size); }
+            for (i = 0; i < size; i++) { sorted[i] = random[i]; }
+            qsort(sorted, size, sizeof(int), &comp_int);
+
+            /*** TEST INT32 KEYS **********************************************/
+
+            for (i = 0; i < size; i++) { i32[i] = (int32_t) random[i]; }
             crono = clock();
-            median_sort_8(array, size);
-            T[8][step] += ((double) (clock() - crono)) / CLOCKS_PER_SEC;
-            for (i = 0; i < size; i++) { assert(array[i] == sorted[i]); }
+            median_sort_i32(i32, size);
+            V[0] += ((double) (clock() - crono)) / CLOCKS_PER_SEC;
+            for (i = 0; i < size; i++) { assert(i32[i] == (int32_t) sorted[i]); }
 
-            for (i = 0; i < size; i++) { array[i] = random[i]; }
+            for (i = 0; i < size; i++) { i32[i] = (int32_t) random[i]; }
             crono = clock();
-            median_sort_9(array, size);
-            T[9][step] += ((double) (clock() - crono)) / CLOCKS_PER_SEC;
-            for (i = 0; i < size; i++) { assert(array[i] == sorted[i]); }
+            median_sort_i32_generic(i32, size);
+            V[1] += ((double) (clock() - crono)) / CLOCKS_PER_SEC;
+            for (i = 0; i < size; i++) { assert(i32[i] == (int32_t) sorted[i]); }
 
-            /*** TEST QUICK SORT *********************************************/
+            /*** TEST FLOAT KEYS **********************************************/
 
-            for (i = 0; i < size; i++) { array[i] = random[i]; }
+            for (i = 0; i < size; i++) { f32[i] = (float) random[i]; }
             crono = clock();
-            quick_sort_0(array, size);
-            T[10][step] += ((double) (clock() - crono)) / CLOCKS_PER_SEC;
-            for (i = 0; i < size; i++) { assert(array[i] == sorted[i]); }
+            median_sort_f32(f32, size);
+            V[2] += ((double) (clock() - crono)) / CLOCKS_PER_SEC;
+            for (i = 0; i < size; i++) { assert(f32[i] == (float) sorted[i]); }
 
-            for (i = 0; i < size; i++) { array[i] = random[i]; }
+            for (i = 0; i < size; i++) { f32[i] = (float) random[i]; }
             crono = clock();
-            quick_sort_1(array, size);
-            T[11][step] += ((double) (clock() - crono)) / CLOCKS_PER_SEC;
-            for (i = 0; i < size; i++) { assert(array[i] == sorted[i]); }
+            median_sort_f32_generic(f32, size);
+            V[3] += ((double) (clock() - crono)) / CLOCKS_PER_SEC;
+            for (i = 0; i < size; i++) { assert(f32[i] == (float) sorted[i]); }
 
-            for (i = 0; i < size; i++) { array[i] = random[i]; }
+            /*** TEST INT64 KEYS **********************************************/
+
+            for (i = 0; i < size; i++) { i64[i] = (int64_t) random[i]; }
             crono = clock();
-            quick_sort_2(array, size);
-            T[12][step] += ((double) (clock() - crono)) / CLOCKS_PER_SEC;
-            for (i = 0; i < size; i++) { assert(array[i] == sorted[i]); }
+            median_sort_i64(i64, size);
+            V[4] += ((double) (clock() - crono)) / CLOCKS_PER_SEC;
+            for (i = 0; i < size; i++) { assert(i64[i] == (int64_t) sorted[i]); }
 
-            for (i = 0; i < size; i++) { array[i] = random[i]; }
+            for (i = 0; i < size; i++) { i64[i] = (int64_t) random[i]; }
             crono = clock();
-            quick_sort_3(array, size);
-            T[13][step] += ((double) (clock() - crono)) / CLOCKS_PER_SEC;
-            for (i = 0; i < size; i++) { assert(array[i] == sorted[i]); }
+            median_sort_i64_generic(i64, size);
+            V[5] += ((double) (clock() - crono)) / CLOCKS_PER_SEC;
+            for (i = 0; i < size; i++) { assert(i64[i] == (int64_t) sorted[i]); }
 
-            for (i = 0; i < size; i++) { array[i] = random[i]; }
+            /*** TEST DOUBLE KEYS *********************************************/
+
+            for (i = 0; i < size; i++) { f64[i] = (double) random[i]; }
             crono = clock();
-            quick_sort_4(array, size);
-            T[14][step] += ((double) (clock() - crono)) / CLOCKS_PER_SEC;
-            for (i = 0; i < size; i++) { assert(array[i] == sorted[i]); }
+            median_sort_f64(f64, size);
+            V[6] += ((double) (clock() - crono)) / CLOCKS_PER_SEC;
+            for (i = 0; i < size; i++) { assert(f64[i] == (double) sorted[i]); }
 
-            for (i = 0; i < size; i++) { array[i] = random[i]; }
+            for (i = 0; i < size; i++) { f64[i] = (double) random[i]; }
             crono = clock();
-            quick_sort_5(array, size);
-            T[15][step] += ((double) (clock() - crono)) / CLOCKS_PER_SEC;
-            for (i = 0; i < size; i++) { assert(array[i] == sorted[i]); }
+            median_sort_f64_generic(f64, size);
+            V[7] += ((double) (clock() - crono)) / CLOCKS_PER_SEC;
+            for (i = 0; i < size; i++) { assert(f64[i] == (double) sorted[i]); }
 
-            for (i = 0; i < size; i++) { array[i] = random[i]; }
+            /*****************************************************************/
+
+        }
+
+        fprintf(stderr, "  median_sort_i32 vs median_sort_i32_generic = %+.2f %%\n", 100.0 * (V[0]-V[1]) / V[1]);
+        fprintf(stderr, "  median_sort_f32 vs median_sort_f32_generic = %+.2f %%\n", 100.0 * (V[2]-V[3]) / V[3]);
+        fprintf(stderr, "  median_sort_i64 vs median_sort_i64_generic = %+.2f %%\n", 100.0 * (V[4]-V[5]) / V[5]);
+        fprintf(stderr, "  median_sort_f64 vs median_sort_f64_generic = %+.2f %%\n", 100.0 * (V[6]-V[7]) / V[7]);
+    }
+
+    for (step = 0; step < 2; step++) {
+
+        size = S[step];
+        for (k = 0; k < 4; k++) { W[k] = 0.0; }
+
+        fprintf(stderr, "\nSORTING %zu ADVERSARIAL INTS\n\n", size);
+
+        /*** GENERATE INSTANCES **********************************************/
+
+        adversary(buffer, array, size, &adversary_median_sort_7);
+        adversary(random, array, size, &adversary_quick_sort_7);
+
+        for (j = 0; j < repeat; j++) {
+
+            /*** TEST MEDIAN SORT ********************************************/
+
+            for (i = 0; i < size; i++) { array[i] = rand_int(size); }
             crono = clock();
-            quick_sort_6(array, size);
-            T[16][step] += ((double) (clock() - crono)) / CLOCKS_PER_SEC;
-            for (i = 0; i < size; i++) { assert(array[i] == sorted[i]); }
+            median_sort_7(array, size);
+            W[0] += ((double) (clock() - crono)) / CLOCKS_PER_SEC;
 
-            for (i = 0; i < size; i++) { array[i] = random[i]; }
+            for (i = 0; i < size; i++) { array[i] = buffer[i]; }
             crono = clock();
-            quick_sort_7(array, size);
-            T[17][step] += ((double) (clock() - crono)) / CLOCKS_PER_SEC;
-            for (i = 0; i < size; i++) { assert(array[i] == sorted[i]); }
+            median_sort_7(array, size);
+            W[1] += ((double) (clock() - crono)) / CLOCKS_PER_SEC;
+            for (i = 1; i < size; i++) { assert(array[i-1] <= array[i]); }
 
-            for (i = 0; i < size; i++) { array[i] = random[i]; }
+            /*** TEST QUICK SORT *********************************************/
+
+            for (i = 0; i < size; i++) { array[i] = rand_int(size); }
             crono = clock();
-            quick_sort_8(array, size);
-            T[18][step] += ((double) (clock() - crono)) / CLOCKS_PER_SEC;
-            for (i = 0; i < size; i++) { assert(array[i] == sorted[i]); }
+            quick_sort_7(array, size);
+            W[2] += ((double) (clock() - crono)) / CLOCKS_PER_SEC;
 
             for (i = 0; i < size; i++) { array[i] = random[i]; }
             crono = clock();
-            quick_sort_9(array, size);
-            T[19][step] += ((double) (clock() - crono)) / CLOCKS_PER_SEC;
-            for (i = 0; i < size; i++) { assert(array[i] == sorted[i]); }
+            quick_sort_7(array, size);
+            W[3] += ((double) (clock() - crono)) / CLOCKS_PER_SEC;
+            for (i = 1; i < size; i++) { assert(array[i-1] <= array[i]); }
 
             /*****************************************************************/
 
         }
 
-        fprintf(stderr, "\n    heap_sort   vs qsort = %+.2f %%\n", 100.0 * (T[21][step]-T[20][step]) / T[20][step]);
-        fprintf(stderr,   "   shell_sort   vs qsort = %+.2f %%\n", 100.0 * (T[22][step]-T[20][step]) / T[20][step]);
-        fprintf(stderr, "\n  median_sort_0 vs qsort = %+.2f %%\n", 100.0 * (T[ 0][step]-T[20][step]) / T[20][step]);
-        fprintf(stderr,   "   quick_sort_0 vs qsort = %+.2f %%\n", 100.0 * (T[10][step]-T[20][step]) / T[20][step]);
-        fprintf(stderr, "\n  median_sort_1 vs qsort = %+.2f %%\n", 100.0 * (T[ 1][step]-T[20][step]) / T[20][step]);
-        fprintf(stderr,   "   quick_sort_1 vs qsort = %+.2f %%\n", 100.0 * (T[11][step]-T[20][step]) / T[20][step]);
-        fprintf(stderr, "\n  median_sort_2 vs qsort = %+.2f %%\n", 100.0 * (T[ 2][step]-T[20][step]) / T[20][step]);
-        fprintf(stderr,   "   quick_sort_2 vs qsort = %+.2f %%\n", 100.0 * (T[12][step]-T[20][step]) / T[20][step]);
-        fprintf(stderr, "\n  median_sort_3 vs qsort = %+.2f %%\n", 100.0 * (T[ 3][step]-T[20][step]) / T[20][step]);
-        fprintf(stderr,   "   quick_sort_3 vs qsort = %+.2f %%\n", 100.0 * (T[13][step]-T[20][step]) / T[20][step]);
-        fprintf(stderr, "\n  median_sort_4 vs qsort = %+.2f %%\n", 100.0 * (T[ 4][step]-T[20][step]) / T[20][step]);
-        fprintf(stderr,   "   quick_sort_4 vs qsort = %+.2f %%\n", 100.0 * (T[14][step]-T[20][step]) / T[20][step]);
-        fprintf(stderr, "\n  median_sort_5 vs qsort = %+.2f %%\n", 100.0 * (T[ 5][step]-T[20][step]) / T[20][step]);
-        fprintf(stderr,   "   quick_sort_5 vs qsort = %+.2f %%\n", 100.0 * (T[15][step]-T[20][step]) / T[20][step]);
-        fprintf(stderr, "\n  median_sort_6 vs qsort = %+.2f %%\n", 100.0 * (T[ 6][step]-T[20][step]) / T[20][step]);
-        fprintf(stderr,   "   quick_sort_6 vs qsort = %+.2f %%\n", 100.0 * (T[16][step]-T[20][step]) / T[20][step]);
-        fprintf(stderr, "\n  median_sort_7 vs qsort = %+.2f %%\n", 100.0 * (T[ 7][step]-T[20][step]) / T[20][step]);
-        fprintf(stderr,   "   quick_sort_7 vs qsort = %+.2f %%\n", 100.0 * (T[17][step]-T[20][step]) / T[20][step]);
-        fprintf(stderr, "\n  median_sort_8 vs qsort = %+.2f %%\n", 100.0 * (T[ 8][step]-T[20][step]) / T[20][step]);
-        fprintf(stderr,   "   quick_sort_8 vs qsort = %+.2f %%\n", 100.0 * (T[18][step]-T[20][step]) / T[20][step]);
-        fprintf(stderr, "\n  median_sort_9 vs qsort = %+.2f %%\n", 100.0 * (T[ 9][step]-T[20][step]) / T[20][step]);
-        fprintf(stderr,   "   quick_sort_9 vs qsort = %+.2f %%\n", 100.0 * (T[19][step]-T[20][step]) / T[20][step]);
+        fprintf(stderr, "  median_sort_7 adversarial vs random = x%.2f\n", W[1] / W[0]);
+        fprintf(stderr, "   quick_sort_7 adversarial vs random = x%.2f\n", W[3] / W[2]);
     }
 
     printf("Size qsort HeapSort");
     for (i = 0; i < 10; i++) { printf(" MedianSort(%zu)", i); }
     for (i = 0; i < 10; i++) { printf(" QuickSort(%zu)", i);  }
     printf(" ShellSort");
+    for (i = 0; i < 10; i++) { printf(" BlockMedianSort(%zu)", i); }
+    for (i = 0; i < 10; i++) { printf(" BlockQuickSort(%zu)", i);  }
     for (step = 0; step < steps; step++) {
         printf("\n%zu %.2f %.2f", S[step], 100.0, 100.0 * T[21][step] / T[20][step]);
         for (i =  0; i < 20; i++) { printf(" %.2f", 100.0 * T[i][step] / T[20][step]); }
         printf(" %.2f", 100.0 * T[22][step] / T[20][step]);
+        for (i = 23; i < 43; i++) { printf(" %.2f", 100.0 * T[i][step] / T[20][step]); }
     }
 
     free(buffer);
     free(random);
     free(sorted);
     free(array);
+    free(keys);
 
     return 0;
 }
+
+#endif